@@ -1,13 +1,24 @@
 #include <stdexcept>
 #include <utility>
 #include <bitset>
+#include <algorithm>
 #include <utility>
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
 
 #include <cstdint>
 #include <cstdlib>
 
 #include <signal.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "config.h"
 #include "lib.h"
 #include "arq-sim.h"
@@ -16,6 +27,7 @@
 
 #ifndef CPU_DEBUG_MODE
 #include "os.h"
+#include "asm.h"
 #endif
 
 namespace Arch
@@ -46,8 +58,21 @@ namespace Arch
 
 	static Terminal *terminal = nullptr;
 	static Cpu *cpu = nullptr;
-	static Memory memory;
-	static Timer timer;
+	static void (*run_machine)() = nullptr;
+
+	using DefaultMachine = std::tuple_element_t<0, Config::Machines>;
+
+#ifdef CPU_DEBUG_MODE
+	using DebugMachine = DefaultMachine;
+#endif
+
+	// memory and timer of each machine, only the ones of the chosen machine are used
+	template <typename M>
+	static Memory<M> memory;
+
+	template <typename M>
+	static Timer<M> timer;
+	static Disk *disk = nullptr;
 	static volatile bool alive = true;
 	static uint64_t cycle = 0;
 	static std::string turn_off_msg;
@@ -70,11 +95,28 @@ namespace Arch
 			return strs[code];
 	}
 
+	static const char *get_vreg_name_str(const uint16_t code)
+	{
+		static constexpr auto strs = std::to_array<const char *>({"v0",
+																  "v1",
+																  "v2",
+																  "v3",
+																  "v4",
+																  "v5",
+																  "v6",
+																  "v7"});
+
+		mylib_assert_exception_msg(code < strs.size(), "invalid vector register code ", code)
+
+			return strs[code];
+	}
+
 	const char *InterruptCode_str(const InterruptCode code)
 	{
 		static constexpr auto strs = std::to_array<const char *>({"Keyboard",
 																  "Timer",
-																  "GPF"});
+																  "GPF",
+																  "Disk"});
 
 		mylib_assert_exception_msg(std::to_underlying(code) < strs.size(), "invalid interrupt code ", std::to_underlying(code))
 
@@ -83,7 +125,7 @@ namespace Arch
 
 	// ---------------------------------------
 
-	VideoOutput::VideoOutput(const uint32_t xinit, const uint32_t xend, const uint32_t yinit, const uint32_t yend)
+	VideoOutput::VideoOutput(const uint32_t xinit, const uint32_t xend, const uint32_t yinit, const uint32_t yend, const bool headless)
 	{
 		const uint32_t w = xend - xinit;
 		const uint32_t h = yend - yinit;
@@ -94,6 +136,12 @@ namespace Arch
 		this->x = 0;
 		this->y = 0;
 
+		if (headless)
+		{
+			this->win = nullptr;
+			return;
+		}
+
 		this->win = newwin(h, w, yinit, xinit);
 		refresh();
 		box(this->win, 0, 0);
@@ -172,6 +220,9 @@ namespace Arch
 
 	void VideoOutput::update()
 	{
+		if (this->win == nullptr)
+			return;
+
 		const auto nrows = this->buffer.get_nrows();
 		const auto ncols = this->buffer.get_ncols();
 
@@ -200,59 +251,87 @@ namespace Arch
 
 	// ---------------------------------------
 
-	Terminal::Terminal()
+	Terminal::Terminal(const bool headless)
 	{
-		const uint32_t total_w = COLS;
-		const uint32_t total_h = LINES;
+		const uint32_t total_w = headless ? Config::headless_columns : COLS;
+		const uint32_t total_h = headless ? Config::headless_lines : LINES;
 
 		this->videos.reserve(std::to_underlying(Type::Count));
 
 		// arch video
-		this->videos.emplace_back(1, total_w / 3, 1, total_h);
+		this->videos.emplace_back(1, total_w / 3, 1, total_h, headless);
 
 		// kernel video
-		this->videos.emplace_back(total_w / 3 + 1, 2 * (total_w / 3), 1, total_h / 2);
+		this->videos.emplace_back(total_w / 3 + 1, 2 * (total_w / 3), 1, total_h / 2, headless);
 
 		// command video
-		this->videos.emplace_back(total_w / 3 + 1, 2 * (total_w / 3), total_h / 2 + 1, total_h);
+		this->videos.emplace_back(total_w / 3 + 1, 2 * (total_w / 3), total_h / 2 + 1, total_h, headless);
 
 		// app video
-		this->videos.emplace_back(2 * (total_w / 3) + 1, total_w, 1, total_h);
+		this->videos.emplace_back(2 * (total_w / 3) + 1, total_w, 1, total_h, headless);
 
 		this->has_char = false;
+		this->char_notified = false;
+		this->headless = headless;
+	}
+
+	void Terminal::print_str(const Type video, const std::string_view str)
+	{
+		if (this->headless && (video == Type::App || video == Type::Command))
+			std::cout << str;
+		else
+			this->videos[std::to_underlying(video)].print(str);
 	}
 
 	Terminal::~Terminal()
 	{
 	}
 
-	void Terminal::run_cycle()
+	void Terminal::run_cycle(const int timeout_ms)
 	{
-		const int typed = getch();
+		if (this->headless)
+			return;
 
-		if (typed != ERR)
+		// keep new keys queued in ncurses until the pending one is read
+		if (!this->has_char)
 		{
-			this->has_char = true;
-			this->typed_char = typed;
+			if (timeout_ms > 0)
+				timeout(timeout_ms);
+
+			const int typed = getch();
+
+			if (timeout_ms > 0)
+				timeout(0);
+
+			if (typed != ERR)
+			{
+				this->has_char = true;
+				this->char_notified = false;
+				this->typed_char = typed;
+			}
 		}
 
-		if (this->has_char)
-			cpu->interrupt(InterruptCode::Keyboard);
+		// one interrupt per key, retried only while another interrupt is pending
+		if (this->has_char && !this->char_notified)
+			this->char_notified = cpu->interrupt(InterruptCode::Keyboard);
 	}
 
 	// ---------------------------------------
 
-	Memory::Memory()
+	template <typename M>
+	Memory<M>::Memory()
 	{
 		for (auto &v : this->data)
 			v = 0;
 	}
 
-	Memory::~Memory()
+	template <typename M>
+	Memory<M>::~Memory()
 	{
 	}
 
-	void Memory::dump(const uint16_t init, const uint16_t end) const
+	template <typename M>
+	void Memory<M>::dump(const uint16_t init, const uint16_t end) const
 	{
 		terminal_println(Arch, "memory dump from paddr " << init << " to " << end) for (uint16_t i = init; i < end; i++)
 			terminal_print(Arch, this->data[i] << " ")
@@ -261,9 +340,10 @@ namespace Arch
 
 	// ---------------------------------------
 
-	void Timer::run_cycle()
+	template <typename M>
+	void Timer<M>::run_cycle()
 	{
-		if (this->count >= Config::timer_interrupt_cycles)
+		if (this->count >= M::timer_interrupt_cycles)
 		{
 			if (cpu->interrupt(InterruptCode::Timer))
 				this->count = 0;
@@ -274,6 +354,102 @@ namespace Arch
 
 	// ---------------------------------------
 
+	Disk::Disk(const std::string_view fname)
+	{
+		this->image = fopen(fname.data(), "r+b");
+
+		if (this->image == nullptr)
+			this->image = fopen(fname.data(), "w+b");
+
+		mylib_assert_exception_msg(this->image != nullptr, "cannot open disk image ", fname)
+
+		// grow the image to the full disk size, new blocks read as zeros
+		fseek(this->image, 0, SEEK_END);
+		const long size = ftell(this->image);
+		const long disk_size = static_cast<long>(Config::disk_blocks) * Config::disk_block_words * sizeof(uint16_t);
+
+		if (size < disk_size)
+		{
+			const uint16_t zero = 0;
+			fseek(this->image, disk_size - static_cast<long>(sizeof(uint16_t)), SEEK_SET);
+			fwrite(&zero, sizeof(uint16_t), 1, this->image);
+			fflush(this->image);
+		}
+	}
+
+	Disk::~Disk()
+	{
+		fclose(this->image);
+	}
+
+	void Disk::read_now(const uint32_t block, uint16_t *dest)
+	{
+		mylib_assert_exception_msg(block < Config::disk_blocks, "invalid disk block ", block)
+
+		fseek(this->image, static_cast<long>(block) * Config::disk_block_words * sizeof(uint16_t), SEEK_SET);
+
+		mylib_assert_exception_msg(fread(dest, sizeof(uint16_t), Config::disk_block_words, this->image) == Config::disk_block_words, "cannot read disk block ", block)
+	}
+
+	void Disk::write_now(const uint32_t block, const uint16_t *src)
+	{
+		mylib_assert_exception_msg(block < Config::disk_blocks, "invalid disk block ", block)
+
+		fseek(this->image, static_cast<long>(block) * Config::disk_block_words * sizeof(uint16_t), SEEK_SET);
+
+		mylib_assert_exception_msg(fwrite(src, sizeof(uint16_t), Config::disk_block_words, this->image) == Config::disk_block_words, "cannot write disk block ", block)
+
+		fflush(this->image);
+	}
+
+	void Disk::submit(const uint32_t block, uint16_t *buffer, const bool write_request)
+	{
+		mylib_assert_exception_msg(!this->busy, "disk request submitted while busy")
+		mylib_assert_exception_msg(block < Config::disk_blocks, "invalid disk block ", block)
+
+		this->busy = true;
+		this->completed = false;
+		this->write_request = write_request;
+		this->block = block;
+		this->buffer = buffer;
+		this->completion_cycle = cycle + Config::disk_latency_cycles;
+	}
+
+	void Disk::read(const uint32_t block, uint16_t *dest)
+	{
+		this->submit(block, dest, false);
+	}
+
+	void Disk::write(const uint32_t block, uint16_t *src)
+	{
+		this->submit(block, src, true);
+	}
+
+	void Disk::run_cycle()
+	{
+		if (!this->busy || cycle < this->completion_cycle)
+			return;
+
+		if (!this->completed)
+		{
+			if (this->write_request)
+				this->write_now(this->block, this->buffer);
+			else
+				this->read_now(this->block, this->buffer);
+
+			this->completed = true;
+		}
+
+		// retry at the next cycles while another interrupt is pending
+		if (cpu->interrupt(InterruptCode::Disk))
+		{
+			this->busy = false;
+			this->completed = false;
+		}
+	}
+
+	// ---------------------------------------
+
 #ifdef CPU_DEBUG_MODE
 
 	static void fake_syscall_handler()
@@ -293,18 +469,70 @@ namespace Arch
 
 	// ---------------------------------------
 
-	Cpu::Cpu()
-		: memory(Arch::memory)
+	// lane by lane arithmetic of the vector instructions, one SSE2 instruction each on x86 hosts
+	template <OpcodeR opcode>
+	static inline Vector vector_op(const Vector &a, const Vector &b)
+	{
+		Vector r;
+
+#if defined(__SSE2__)
+		static_assert(sizeof(Vector) == sizeof(__m128i));
+
+		const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a.data()));
+		const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b.data()));
+		__m128i z;
+
+		if constexpr (opcode == OpcodeR::Vadd)
+			z = _mm_add_epi16(x, y);
+		else if constexpr (opcode == OpcodeR::Vsub)
+			z = _mm_sub_epi16(x, y);
+		else if constexpr (opcode == OpcodeR::Vmul)
+			z = _mm_mullo_epi16(x, y);
+		else
+			z = _mm_and_si128(_mm_cmpeq_epi16(x, y), _mm_set1_epi16(1));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(r.data()), z);
+#else
+		for (uint32_t i = 0; i < r.size(); i++)
+		{
+			if constexpr (opcode == OpcodeR::Vadd)
+				r[i] = a[i] + b[i];
+			else if constexpr (opcode == OpcodeR::Vsub)
+				r[i] = a[i] - b[i];
+			else if constexpr (opcode == OpcodeR::Vmul)
+				r[i] = a[i] * b[i];
+			else
+				r[i] = (a[i] == b[i]);
+		}
+#endif
+
+		return r;
+	}
+
+	// ---------------------------------------
+
+	Cpu::Cpu(const MachineInfo &machine, uint16_t *pmem)
+		: machine(machine), pmem(pmem)
 	{
 		for (auto &r : this->gprs)
 			r = 0;
+
+		for (auto &v : this->vregs)
+			v.fill(0);
 	}
 
 	Cpu::~Cpu()
 	{
 	}
 
-	void Cpu::run_cycle()
+	template <typename M>
+	CpuModel<M>::CpuModel(Memory<M> &memory)
+		: Cpu(machine_info<M>, memory.get_raw()), memory(memory)
+	{
+	}
+
+	template <typename M>
+	void CpuModel<M>::run_cycle()
 	{
 		enum class InstrType : uint16_t
 		{
@@ -319,7 +547,11 @@ namespace Arch
 			return;
 		}
 
-		const Mylib::BitSet<16> instruction = this->vmem_read(this->pc);
+		if (this->halted)
+			return;
+
+		bool verified;
+		const Mylib::BitSet<16> instruction = this->vmem_fetch(this->pc, verified);
 
 		if (this->has_interrupt)
 		{
@@ -334,10 +566,13 @@ namespace Arch
 
 		const InstrType type = static_cast<InstrType>(instruction[15]);
 
+		// counted before executing, a syscall may switch to another process
+		this->executed_instructions++;
+
 		if (type == InstrType::R)
-			this->execute_r(instruction);
+			verified ? this->execute_r<true>(instruction) : this->execute_r<false>(instruction);
 		else
-			this->execute_i(instruction);
+			verified ? this->execute_i<true>(instruction) : this->execute_i<false>(instruction);
 
 		if (this->has_interrupt)
 		{
@@ -348,6 +583,11 @@ namespace Arch
 		this->dump();
 	}
 
+	uint64_t Cpu::get_cycle() const
+	{
+		return cycle;
+	}
+
 	void Cpu::turn_off()
 	{
 		alive = false;
@@ -367,26 +607,40 @@ namespace Arch
 		mylib_assert_exception(this->has_interrupt == false) this->interrupt(interrupt_code);
 	}
 
-	void Cpu::execute_r(const Mylib::BitSet<16> instruction)
+	template <typename M>
+	bool CpuModel<M>::check_write_access(const uint16_t vaddr)
 	{
-		enum class OpcodeR : uint16_t
-		{
-			Add = 0,
-			Sub = 1,
-			Mul = 2,
-			Div = 3,
-			Cmp_equal = 4,
-			Cmp_neq = 5,
-			Load = 15,
-			Store = 16,
-			Syscall = 63
-		};
+		const uint32_t page_number = SmallPage::number(vaddr);
 
+		// invalid pages are reported by translate
+		if (page_number >= this->page_table->frames.size() || !this->page_table->frames[page_number].valid)
+			return true;
+
+		if (this->page_table->frames[page_number].writable)
+			return true;
+
+#ifdef CPU_DEBUG_MODE
+		return false;
+#else
+		return OS::write_fault(vaddr);
+#endif
+	}
+
+	template <typename M>
+	template <bool verified>
+	void CpuModel<M>::execute_r(const Mylib::BitSet<16> instruction)
+	{
 		const OpcodeR opcode = static_cast<OpcodeR>(instruction(9, 6));
 		const uint16_t dest = instruction(6, 3);
 		const uint16_t op1 = instruction(3, 3);
 		const uint16_t op2 = instruction(0, 3);
 
+		if constexpr (!verified)
+		{
+			if (!this->valid_regs(opcode, dest, op1, op2))
+				return;
+		}
+
 		switch (opcode)
 		{
 			using enum OpcodeR;
@@ -423,6 +677,91 @@ namespace Arch
 			terminal_println(Arch, "\tstore [" << get_reg_name_str(op1) << "], " << get_reg_name_str(op2)) this->vmem_write(this->gprs[op1], this->gprs[op2]);
 			break;
 
+		case Copy_block:
+			terminal_println(Arch, "\tcopy_block " << get_reg_name_str(dest) << ", " << get_reg_name_str(op1) << ", " << get_reg_name_str(op2))
+			this->for_each_block_run(this->gprs[dest], this->gprs[op1], this->gprs[op2], true, [] (uint16_t *to, const uint16_t *from, const uint32_t n) {
+				// a destination just above the source repeats the words, as a loop of loads and stores would
+				if (to > from && to < from + n)
+				{
+					for (uint32_t i = 0; i < n; i++)
+						to[i] = from[i];
+				}
+				else
+					std::copy_n(from, n, to);
+				return true;
+			});
+			break;
+
+		case Fill_block:
+			terminal_println(Arch, "\tfill_block " << get_reg_name_str(dest) << ", " << get_reg_name_str(op1) << ", " << get_reg_name_str(op2))
+			this->for_each_block_run(this->gprs[dest], this->gprs[dest], this->gprs[op2], true, [value = this->gprs[op1]] (uint16_t *to, const uint16_t *, const uint32_t n) {
+				std::fill_n(to, n, value);
+				return true;
+			});
+			break;
+
+		case Cmp_block:
+		{
+			terminal_println(Arch, "\tcmp_block " << get_reg_name_str(dest) << ", " << get_reg_name_str(op1) << ", " << get_reg_name_str(op2))
+			bool equal = true;
+			this->for_each_block_run(this->gprs[op1], this->gprs[op2], this->gprs[dest], false, [&equal] (uint16_t *a, const uint16_t *b, const uint32_t n) {
+				equal = std::equal(a, a + n, b);
+				return equal;
+			});
+			this->gprs[dest] = equal;
+		}
+		break;
+
+		case Vload:
+		{
+			terminal_println(Arch, "\tvload " << get_vreg_name_str(dest) << ", [" << get_reg_name_str(op1) << "]")
+			uint16_t *lane = this->vregs[dest].data();
+			this->for_each_block_run(this->gprs[op1], this->gprs[op1], Config::vector_lanes, false, [&lane] (uint16_t *from, const uint16_t *, const uint32_t n) {
+				lane = std::copy_n(from, n, lane);
+				return true;
+			});
+		}
+		break;
+
+		case Vstore:
+		{
+			terminal_println(Arch, "\tvstore [" << get_reg_name_str(op1) << "], " << get_vreg_name_str(op2))
+			const uint16_t *lane = this->vregs[op2].data();
+			this->for_each_block_run(this->gprs[op1], this->gprs[op1], Config::vector_lanes, true, [&lane] (uint16_t *to, const uint16_t *, const uint32_t n) {
+				std::copy_n(lane, n, to);
+				lane += n;
+				return true;
+			});
+		}
+		break;
+
+		case Vadd:
+			terminal_println(Arch, "\tvadd " << get_vreg_name_str(dest) << ", " << get_vreg_name_str(op1) << ", " << get_vreg_name_str(op2)) this->vregs[dest] = vector_op<Vadd>(this->vregs[op1], this->vregs[op2]);
+			break;
+
+		case Vsub:
+			terminal_println(Arch, "\tvsub " << get_vreg_name_str(dest) << ", " << get_vreg_name_str(op1) << ", " << get_vreg_name_str(op2)) this->vregs[dest] = vector_op<Vsub>(this->vregs[op1], this->vregs[op2]);
+			break;
+
+		case Vmul:
+			terminal_println(Arch, "\tvmul " << get_vreg_name_str(dest) << ", " << get_vreg_name_str(op1) << ", " << get_vreg_name_str(op2)) this->vregs[dest] = vector_op<Vmul>(this->vregs[op1], this->vregs[op2]);
+			break;
+
+		case Vcmp_equal:
+			terminal_println(Arch, "\tvcmp_equal " << get_vreg_name_str(dest) << ", " << get_vreg_name_str(op1) << ", " << get_vreg_name_str(op2)) this->vregs[dest] = vector_op<Vcmp_equal>(this->vregs[op1], this->vregs[op2]);
+			break;
+
+		case Vsplat:
+			terminal_println(Arch, "\tvsplat " << get_vreg_name_str(dest) << ", " << get_reg_name_str(op1)) this->vregs[dest].fill(this->gprs[op1]);
+			break;
+
+		case Vsum:
+			terminal_println(Arch, "\tvsum " << get_reg_name_str(dest) << ", " << get_vreg_name_str(op1))
+			this->gprs[dest] = 0;
+			for (const uint16_t v : this->vregs[op1])
+				this->gprs[dest] += v;
+			break;
+
 		case Syscall:
 			terminal_println(Arch, "\tsyscall");
 #ifdef CPU_DEBUG_MODE
@@ -433,23 +772,27 @@ namespace Arch
 			break;
 
 		default:
-			mylib_assert_exception_diecode_msg(false, endwin();, "Unknown opcode ", static_cast<uint16_t>(opcode));
+			if constexpr (verified)
+				std::unreachable();
+			else
+				this->force_interrupt(InterruptCode::GPF);
 		}
 	}
 
-	void Cpu::execute_i(const Mylib::BitSet<16> instruction)
+	template <typename M>
+	template <bool verified>
+	void CpuModel<M>::execute_i(const Mylib::BitSet<16> instruction)
 	{
-		enum class OpcodeI : uint16_t
-		{
-			Jump = 0,
-			Jump_cond = 1,
-			Mov = 3
-		};
-
 		const OpcodeI opcode = static_cast<OpcodeI>(instruction(13, 2));
 		const uint16_t reg = instruction(10, 3);
 		const uint16_t imed = instruction(0, 9);
 
+		if constexpr (!verified)
+		{
+			if (!this->valid_regs(reg))
+				return;
+		}
+
 		switch (opcode)
 		{
 			using enum OpcodeI;
@@ -467,23 +810,58 @@ namespace Arch
 			break;
 
 		default:
-			mylib_assert_exception_diecode_msg(false, endwin();, "Unknown opcode ", static_cast<uint16_t>(opcode));
+			if constexpr (verified)
+				std::unreachable();
+			else
+				this->force_interrupt(InterruptCode::GPF);
 		}
 	}
 
 	void Cpu::dump() const
 	{
-		terminal_print(Arch, "gprs:") for (uint32_t i = 0; i < this->gprs.size(); i++)
+		terminal_print(Arch, "gprs:") for (uint32_t i = 0; i < this->machine.nregs; i++)
 			terminal_print(Arch, " " << this->gprs[i])
 				terminal_println(Arch, "")
 	}
 
 	// ---------------------------------------
 
-	void init()
+	// creates the cpu of the machine called name, returns false if there is none
+	template <size_t i = 0>
+	static bool create_cpu(const std::string_view name);
+
+	// names of the machines built into the simulator, separated by |
+	static std::string machine_names()
+	{
+		std::string names;
+
+		std::apply([&names] (const auto... machines) {
+			((names += (names.empty() ? "" : "|") + std::string(machines.name)), ...);
+		}, Config::Machines());
+
+		return names;
+	}
+
+	// parameters of the machine called name, nullptr if there is none
+	static const MachineInfo *find_machine(const std::string_view name)
+	{
+		const MachineInfo *found = nullptr;
+
+		std::apply([&found, name] (const auto... machines) {
+			((found = (found == nullptr && name == machines.name) ? &machine_info<decltype(machines)> : found), ...);
+		}, Config::Machines());
+
+		return found;
+	}
+
+	bool init(const bool headless, const std::string_view machine)
 	{
+		if (!create_cpu(machine))
+			return false;
+
 #ifndef CPU_DEBUG_MODE
-		terminal = new Terminal;
+		terminal = new Terminal(headless);
+		disk = new Disk(Config::disk_image);
 #endif
 
 		// terminal_println(Arch, "teste arch 123456789123456789123456789123456789123456789123456789");
@@ -491,18 +869,69 @@ namespace Arch
 		//  terminal_println(Command, "teste command");
 		//  terminal_println(App, "teste app");
 
-		cpu = new Cpu;
+		return true;
+	}
+
+#ifndef CPU_DEBUG_MODE
+	// only the idle process is runnable: instead of executing it,
+	// jump the clock to the earliest of the cpu wakeup cycle and the next keyboard poll
+	// a disk completion due at the wakeup takes precedence over the timer interrupt
+	static void fast_forward()
+	{
+		const uint64_t poll_cycle = cycle + Config::idle_poll_cycles;
+		const uint64_t wakeup_cycle = cpu->get_halt_until_cycle();
+
+		// without a keyboard only the wakeup can end the halt
+		if (terminal->is_headless())
+		{
+			if (wakeup_cycle == UINT64_MAX)
+			{
+				terminal->println(Terminal::Type::Kernel, "Halted with nothing left to wake up\n");
+				alive = false;
+				return;
+			}
+
+			cycle = std::max(cycle, wakeup_cycle);
+			disk->run_cycle();
+			cpu->interrupt(InterruptCode::Timer);
+			return;
+		}
+
+		if (wakeup_cycle > poll_cycle)
+		{
+			terminal->run_cycle(Config::idle_poll_ms);
+			cycle = poll_cycle;
+		}
+		else
+		{
+			terminal->run_cycle();
+			cycle = std::max(cycle, wakeup_cycle);
+			disk->run_cycle();
+			cpu->interrupt(InterruptCode::Timer);
+		}
 	}
+#endif
 
+	template <typename M>
 	void run_cycle()
 	{
+#ifndef CPU_DEBUG_MODE
+		if (cpu->is_halted())
+		{
+			fast_forward();
+			return;
+		}
+#endif
+
 		terminal_println(Arch, "starting cycle " << cycle);
 
 #ifndef CPU_DEBUG_MODE
 		terminal->run_cycle();
-		timer.run_cycle();
+		timer<M>.run_cycle();
+		disk->run_cycle();
 #endif
-		cpu->run_cycle();
+		// CpuModel is final, so this call is bound at compile time
+		static_cast<CpuModel<M> *>(cpu)->run_cycle();
 
 #ifdef CPU_DEBUG_MODE
 //	getchar();
@@ -511,10 +940,35 @@ namespace Arch
 		cycle++;
 	}
 
-	void run()
+	template <typename M>
+	void run_loop()
 	{
 		while (alive)
-			run_cycle();
+			run_cycle<M>();
+	}
+
+	template <size_t i>
+	static bool create_cpu(const std::string_view name)
+	{
+		if constexpr (i == std::tuple_size_v<Config::Machines>)
+			return false;
+		else
+		{
+			using M = std::tuple_element_t<i, Config::Machines>;
+
+			if (name != M::name)
+				return create_cpu<i + 1>(name);
+
+			cpu = new CpuModel<M>(memory<M>);
+			run_machine = &run_loop<M>;
+
+			return true;
+		}
+	}
+
+	void run()
+	{
+		run_machine();
 	}
 
 	// ---------------------------------------
@@ -531,52 +985,179 @@ static void interrupt_handler(int dummy)
 
 #ifdef CPU_DEBUG_MODE
 	Arch::cpu->dump();
-	Arch::memory.dump(0, 255);
+	Arch::memory<Arch::DebugMachine>.dump(0, 255);
 #endif
 
 	exit(1);
 }
 
+#ifndef CPU_DEBUG_MODE
+// writes the image to output and the listing next to it, with the .lst extension
+static int assemble_file(const char *source, const char *output, const Arch::MachineInfo &machine, const bool optimize)
+{
+	std::ifstream in(source);
+
+	if (!in)
+	{
+		printf("cannot open %s\n", source);
+		return 1;
+	}
+
+	std::ostringstream text;
+	text << in.rdbuf();
+
+	try
+	{
+		const Asm::Result result = Asm::assemble(text.str(), machine.nregs, optimize);
+
+		std::ofstream out(output, std::ios::binary);
+		out.write(reinterpret_cast<const char *>(result.image.data()), result.image.size() * sizeof(uint16_t));
+
+		std::ofstream(std::filesystem::path(output).replace_extension(".lst")) << result.listing;
+
+		printf("%s: %u instructions, %u before optimization\n", output, result.instructions_after, result.instructions_before);
+	}
+	catch (const std::exception &e)
+	{
+		printf("%s: %s\n", source, e.what());
+		return 1;
+	}
+
+	return 0;
+}
+
+static int disassemble_file(const char *fname)
+{
+	try
+	{
+		std::cout << Asm::disassemble(Lib::load_executable(fname));
+	}
+	catch (const std::exception &e)
+	{
+		printf("%s\n", e.what());
+		return 1;
+	}
+
+	return 0;
+}
+#endif
+
 int main(int argc, char **argv)
 {
+	bool headless = false;
+	std::string_view machine = Arch::DefaultMachine::name;
+
 #ifdef CPU_DEBUG_MODE
 	if (argc != 2)
 	{
 		printf("usage: %s [bin_name]\n", argv[0]);
 		exit(1);
 	}
+#else
+	const char *script = nullptr;
+	const char *asm_source = nullptr;
+	const char *asm_output = nullptr;
+	const char *disasm = nullptr;
+	bool optimize = true;
+	bool valid_args = true;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::string_view(argv[i]) == "--headless")
+			headless = true;
+		else if (std::string_view(argv[i]) == "--machine" && i + 1 < argc)
+			machine = argv[++i];
+		else if (std::string_view(argv[i]) == "--asm" && i + 2 < argc)
+		{
+			asm_source = argv[++i];
+			asm_output = argv[++i];
+		}
+		else if (std::string_view(argv[i]) == "--disasm" && i + 1 < argc)
+			disasm = argv[++i];
+		else if (std::string_view(argv[i]) == "--O0")
+			optimize = false;
+		else if (script == nullptr)
+			script = argv[i];
+		else
+			valid_args = false;
+	}
+
+	// a headless run has no keyboard, so it needs a script
+	if (!valid_args || (headless && script == nullptr))
+	{
+		printf("usage: %s [--headless] [--machine %s] [script]\n", argv[0], Arch::machine_names().c_str());
+		printf("       %s --asm source output.bin [--O0] [--machine m]\n", argv[0]);
+		printf("       %s --disasm file.bin\n", argv[0]);
+		exit(1);
+	}
+
+	// the assembler allocates the registers of the chosen machine
+	if (asm_source != nullptr || disasm != nullptr)
+	{
+		const Arch::MachineInfo *info = Arch::find_machine(machine);
+
+		if (info == nullptr)
+		{
+			printf("unknown machine %s, the machines are %s\n", machine.data(), Arch::machine_names().c_str());
+			exit(1);
+		}
+
+		exit(asm_source != nullptr ? assemble_file(asm_source, asm_output, *info, optimize) : disassemble_file(disasm));
+	}
 #endif
 
 	signal(SIGINT, interrupt_handler);
 
 #ifndef CPU_DEBUG_MODE
-	initscr();
-	timeout(0); // non-blocking input
-	noecho();	// don't print input
+	if (!headless)
+	{
+		initscr();
+		timeout(0); // non-blocking input
+		noecho();	// don't print input
+	}
 #endif
 
-	Arch::init();
+	if (!Arch::init(headless, machine))
+	{
+#ifndef CPU_DEBUG_MODE
+		if (!headless)
+			endwin();
+#endif
+		printf("unknown machine %s, the machines are %s\n", machine.data(), Arch::machine_names().c_str());
+		exit(1);
+	}
 
 #ifdef CPU_DEBUG_MODE
-	Lib::load_binary_to_memory(argv[1], static_cast<void *>(Arch::memory.get_raw()), Config::memsize_words * sizeof(uint16_t));
+	Lib::load_binary_to_memory(argv[1], static_cast<void *>(Arch::memory<Arch::DebugMachine>.get_raw()), Arch::DebugMachine::memsize_words * sizeof(uint16_t));
 	Arch::cpu->set_pc(1);
 #else
-	OS::boot(Arch::terminal, Arch::cpu);
+	OS::boot(Arch::terminal, Arch::cpu, Arch::disk);
+
+	if (script != nullptr && !OS::load_script(script))
+		Arch::cpu->turn_off();
 #endif
 
 	Arch::run();
 
+#ifndef CPU_DEBUG_MODE
+	OS::shutdown();
+#endif
+
 #ifdef CPU_DEBUG_MODE
 	Arch::cpu->dump();
-	Arch::memory.dump(0, 255);
+	Arch::memory<Arch::DebugMachine>.dump(0, 255);
 #endif
 
 #ifndef CPU_DEBUG_MODE
-	endwin();
+	if (!headless)
+		endwin();
 
 	// print kernel msgs
 	Arch::terminal->dump(Arch::Terminal::Type::Kernel);
 	std::cout << std::endl;
+
+	if (script != nullptr)
+		OS::print_summary(std::cout);
 #endif
 
 	return 0;
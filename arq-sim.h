@@ -2,11 +2,13 @@
 #define __ARQSIM_HEADER_ARQSIM_H__
 
 #include <array>
+#include <algorithm>
 #include <vector>
 #include <string>
 #include <string_view>
 
 #include <cstdint>
+#include <cstdio>
 
 #if defined(CONFIG_TARGET_LINUX)
 #include <ncurses.h>
@@ -31,26 +33,167 @@ namespace Arch
 	{
 		uint32_t frame_number;
 		bool valid;
+		bool writable = true;
+		bool cow = false; // frame is shared and must be copied on the first store
+		bool shared = false; // frame belongs to a shared memory segment
+		bool executable = true; // instructions can be fetched from the page
+		bool verified = false; // every word is a valid instruction, checked when the image was loaded
+		bool write_trap = false; // writable page mapped read-only so the first store clears verified
 	};
 
+	// address arithmetic of pages of 2^shift words
+	template <uint32_t shift>
+	struct PageGeometry
+	{
+		static inline constexpr uint32_t size_words = 1 << shift;
+
+		static inline constexpr uint32_t number(const uint32_t vaddr)
+		{
+			return vaddr >> shift;
+		}
+
+		static inline constexpr uint32_t offset(const uint32_t vaddr)
+		{
+			return vaddr & (size_words - 1);
+		}
+	};
+
+	using LargePage = PageGeometry<Config::large_page_shift>;
+
 	struct PageTable
 	{
 		std::vector<PageTableBase> frames;
+
+		// a valid entry maps the whole large page to contiguous frames,
+		// the entries in frames stay filled in so the kernel can still work on single pages
+		std::vector<PageTableBase> large_frames;
 	};
 
+	// parameters of the machine chosen at startup, for the code outside the specialized hot paths
+	struct MachineInfo
+	{
+		const char *name;
+		uint32_t nregs;
+		uint32_t memsize_words;
+		uint32_t timer_interrupt_cycles;
+		uint32_t page_shift;
+		uint32_t page_size_words;
+	};
+
+	template <typename M>
+	inline constexpr MachineInfo machine_info = {M::name, M::nregs, M::memsize_words, M::timer_interrupt_cycles, M::page_shift, M::page_size_words};
+
 	// ---------------------------------------
 
 	enum class InterruptCode : uint16_t
 	{
 		Keyboard,
 		Timer,
-		GPF
+		GPF,
+		Disk
 	};
 
 	const char *InterruptCode_str(const InterruptCode code);
 
 	// ---------------------------------------
 
+	// instruction encodings, shared by the cpu and the assembler
+	// R: 0 | opcode (6 bits) | dest (3) | op1 (3) | op2 (3)
+	// I: 1 | opcode (2 bits) | reg (3) | unused (1) | immediate (9)
+
+	enum class OpcodeR : uint16_t
+	{
+		Add = 0,
+		Sub = 1,
+		Mul = 2,
+		Div = 3,
+		Cmp_equal = 4,
+		Cmp_neq = 5,
+		Load = 15,
+		Store = 16,
+		Copy_block = 17, // copy_block rd, rs, rn: copies rn words from [rs] to [rd], in ascending order
+		Fill_block = 18, // fill_block rd, rv, rn: stores rv in rn words from [rd]
+		Cmp_block = 19,  // cmp_block rn, ra, rb: rn = 1 if the rn words at [ra] and [rb] are equal, 0 otherwise
+		Vload = 20,      // vload vd, [rs]: loads vector_lanes words from [rs]
+		Vstore = 21,     // vstore [rs], vs
+		Vadd = 22,       // vadd vd, va, vb, lane by lane
+		Vsub = 23,
+		Vmul = 24,
+		Vcmp_equal = 25, // each lane of vd = 1 if the lanes of va and vb are equal, 0 otherwise
+		Vsplat = 26,     // vsplat vd, rs: every lane of vd = rs
+		Vsum = 27,       // vsum rd, vs: rd = sum of the lanes of vs
+		Syscall = 63
+	};
+
+	enum class OpcodeI : uint16_t
+	{
+		Jump = 0,
+		Jump_cond = 1,
+		Mov = 3
+	};
+
+	// fields of an R instruction that name general purpose registers, the others name vector registers
+	// bit 2 is dest, bit 1 is op1 and bit 0 is op2
+	inline constexpr uint16_t scalar_fields(const OpcodeR opcode)
+	{
+		switch (opcode)
+		{
+			using enum OpcodeR;
+
+		case Vload: case Vstore: case Vsplat:
+			return 0b010;
+
+		case Vadd: case Vsub: case Vmul: case Vcmp_equal:
+			return 0b000;
+
+		case Vsum:
+			return 0b100;
+
+		default:
+			return 0b111;
+		}
+	}
+
+	// true if the scalar fields of an R instruction name registers below nregs
+	inline constexpr bool valid_fields(const OpcodeR opcode, const uint16_t dest, const uint16_t op1, const uint16_t op2, const uint32_t nregs)
+	{
+		const uint16_t fields = scalar_fields(opcode);
+
+		return (!(fields & 0b100) || dest < nregs) && (!(fields & 0b010) || op1 < nregs) && (!(fields & 0b001) || op2 < nregs);
+	}
+
+	// true if word encodes an instruction that only names registers below nregs
+	inline bool valid_instruction(const uint16_t word, const uint32_t nregs)
+	{
+		if (word & 0x8000)
+		{
+			const uint16_t opcode = (word >> 13) & 0x03;
+			const uint16_t reg = (word >> 10) & 0x07;
+
+			return opcode != 2 && reg < nregs;
+		}
+
+		const OpcodeR opcode = static_cast<OpcodeR>((word >> 9) & 0x3F);
+
+		switch (opcode)
+		{
+			using enum OpcodeR;
+
+		case Add: case Sub: case Mul: case Div: case Cmp_equal: case Cmp_neq: case Load: case Store:
+		case Copy_block: case Fill_block: case Cmp_block: case Syscall:
+		case Vload: case Vstore: case Vadd: case Vsub: case Vmul: case Vcmp_equal: case Vsplat: case Vsum:
+			return valid_fields(opcode, (word >> 6) & 0x07, (word >> 3) & 0x07, word & 0x07, nregs);
+
+		default:
+			return false;
+		}
+	}
+
+	// contents of a vector register, lane i is loaded from and stored to word i of the block
+	using Vector = std::array<uint16_t, Config::vector_lanes>;
+
+	// ---------------------------------------
+
 	class VideoOutput
 	{
 	private:
@@ -65,7 +208,8 @@ namespace Arch
 		uint32_t y;
 
 	public:
-		VideoOutput(const uint32_t xinit, const uint32_t xend, const uint32_t yinit, const uint32_t yend);
+		// a headless output only keeps the text buffer, without an ncurses window
+		VideoOutput(const uint32_t xinit, const uint32_t xend, const uint32_t yinit, const uint32_t yend, const bool headless = false);
 		~VideoOutput();
 
 		void print(const std::string_view str);
@@ -95,12 +239,17 @@ namespace Arch
 		std::vector<VideoOutput> videos;
 		int typed_char;
 		bool has_char;
+		bool char_notified; // keyboard interrupt delivered for typed_char
+		bool headless;
 
 	public:
-		Terminal();
+		// headless terminals do not use ncurses: there is no keyboard,
+		// App and Command output goes to stdout and the other windows are only kept for dump()
+		Terminal(const bool headless = false);
 		~Terminal();
 
-		void run_cycle();
+		// timeout_ms > 0 blocks the host until a key is typed or the timeout expires
+		void run_cycle(const int timeout_ms = 0);
 
 		inline int read_typed_char()
 		{
@@ -128,11 +277,18 @@ namespace Arch
 			return (c == '\n');
 		}
 
-		void print_str(const Type video, const std::string_view str)
+		inline bool is_escape(const int c)
+		{
+			return (c == 27);
+		}
+
+		inline bool is_headless() const
 		{
-			this->videos[std::to_underlying(video)].print(str);
+			return this->headless;
 		}
 
+		void print_str(const Type video, const std::string_view str);
+
 		template <typename... Types>
 		void print(const Type video, Types &&...vars)
 		{
@@ -154,10 +310,11 @@ namespace Arch
 
 	// ---------------------------------------
 
+	template <typename M>
 	class Memory
 	{
 	private:
-		std::array<uint16_t, Config::memsize_words> data;
+		std::array<uint16_t, M::memsize_words> data;
 
 	public:
 		Memory();
@@ -178,11 +335,12 @@ namespace Arch
 			mylib_assert_exception(paddr < this->data.size()) return this->data[paddr];
 		}
 
-		void dump(const uint16_t init = 0, const uint16_t end = Config::memsize_words - 1) const;
+		void dump(const uint16_t init = 0, const uint16_t end = M::memsize_words - 1) const;
 	};
 
 	// ---------------------------------------
 
+	template <typename M>
 	class Timer
 	{
 	private:
@@ -194,75 +352,297 @@ namespace Arch
 
 	// ---------------------------------------
 
-	class Cpu
+	// block device backed by an image file
+	// a single request is served at a time: the transfer happens
+	// disk_latency_cycles after submission and is signaled by a Disk interrupt
+	class Disk
 	{
 	private:
-		std::array<uint16_t, Config::nregs> gprs;
+		FILE *image;
+		bool busy = false;
+		bool completed = false; // transfer done, interrupt not delivered yet
+		bool write_request;
+		uint32_t block;
+		uint16_t *buffer;
+		uint64_t completion_cycle = UINT64_MAX;
+
+	public:
+		Disk(const std::string_view fname);
+		~Disk();
+
+		// the buffer must stay valid until the Disk interrupt
+		void read(const uint32_t block, uint16_t *dest);
+		void write(const uint32_t block, uint16_t *src);
+
+		// synchronous transfers, bypassing the request queue
+		void read_now(const uint32_t block, uint16_t *dest);
+		void write_now(const uint32_t block, const uint16_t *src);
+
+		inline bool is_busy() const
+		{
+			return this->busy;
+		}
+
+		inline uint64_t get_completion_cycle() const
+		{
+			return this->busy ? this->completion_cycle : UINT64_MAX;
+		}
+
+		void run_cycle();
+
+	private:
+		void submit(const uint32_t block, uint16_t *buffer, const bool write_request);
+	};
+
+	// ---------------------------------------
+
+	// State and kernel interface common to every machine.
+	// The kernel only uses this class, the simulation loop runs a CpuModel directly.
+	class Cpu
+	{
+	protected:
+		std::array<uint16_t, Config::max_nregs> gprs;
+		std::array<Vector, Config::vector_regs> vregs;
 		InterruptCode interrupt_code;
 		bool has_interrupt = false;
+		bool halted = false;
+		uint64_t halt_until_cycle = 0;
 
 		OO_ENCAPSULATE_SCALAR(uint16_t, pc)
-		OO_ENCAPSULATE_SCALAR_INIT(uint16_t, vmem_paddr_init, 0)
-		OO_ENCAPSULATE_SCALAR_INIT(uint16_t, vmem_paddr_end, Config::memsize_words - 1)
 
-		OO_ENCAPSULATE_SCALAR_INIT_READONLY(uint16_t, pmem_size_words, Config::memsize_words)
+		OO_ENCAPSULATE_SCALAR_INIT_READONLY(uint64_t, executed_instructions, 0)
+		OO_ENCAPSULATE_SCALAR_INIT_READONLY(uint64_t, tlb_hits, 0)
+		OO_ENCAPSULATE_SCALAR_INIT_READONLY(uint64_t, tlb_misses, 0) // page table walks
 
-	private:
-		Memory &memory;
+	protected:
+		const MachineInfo &machine;
+		uint16_t *pmem;
 		PageTable *page_table;
 
+		struct TlbEntry
+		{
+			uint32_t page_number; // of the small or large page
+			uint32_t frame_number;
+			bool large;
+			bool valid = false;
+		};
+
+		std::array<TlbEntry, Config::tlb_entries> tlb;
+		uint32_t tlb_next = 0; // replaced in fifo order
+
 	public:
-		Cpu();
-		~Cpu();
+		Cpu(const MachineInfo &machine, uint16_t *pmem);
+		virtual ~Cpu();
+
+		virtual void run_cycle() = 0;
+
+		// translates with any page table, raising a GPF for unmapped pages
+		// only translations of the current page table go through the tlb
+		virtual uint32_t translate(PageTable *page_table, const uint32_t virtual_address) = 0;
 
-		void run_cycle();
 		void dump() const;
 
+		uint64_t get_cycle() const;
+
+		inline const MachineInfo &get_machine() const
+		{
+			return this->machine;
+		}
+
+		// stops fetching instructions until resume() is called
+		// a timer interrupt is raised once wakeup_cycle is reached
+		inline void halt(const uint64_t wakeup_cycle)
+		{
+			this->halted = true;
+			this->halt_until_cycle = wakeup_cycle;
+		}
+
+		inline void resume()
+		{
+			this->halted = false;
+		}
+
+		inline bool is_halted() const
+		{
+			return this->halted && !this->has_interrupt;
+		}
+
+		inline uint64_t get_halt_until_cycle() const
+		{
+			return this->halt_until_cycle;
+		}
+
 		void set_page_table(PageTable *page_table)
 		{
 			this->page_table = page_table;
+			this->flush_tlb();
+		}
+
+		// must be called when a mapping of the current page table changes or goes away
+		inline void flush_tlb()
+		{
+			for (TlbEntry &entry : this->tlb)
+				entry.valid = false;
 		}
 
 		inline uint16_t get_gpr(const uint8_t code) const
 		{
-			mylib_assert_exception(code < this->gprs.size()) return this->gprs[code];
+			mylib_assert_exception(code < this->machine.nregs) return this->gprs[code];
 		}
 
 		inline void set_gpr(const uint8_t code, const uint16_t v)
 		{
-			mylib_assert_exception(code < this->gprs.size()) this->gprs[code] = v;
+			mylib_assert_exception(code < this->machine.nregs) this->gprs[code] = v;
+		}
+
+		inline const Vector &get_vreg(const uint8_t code) const
+		{
+			mylib_assert_exception(code < Config::vector_regs) return this->vregs[code];
+		}
+
+		inline void set_vreg(const uint8_t code, const Vector &v)
+		{
+			mylib_assert_exception(code < Config::vector_regs) this->vregs[code] = v;
 		}
 
 		inline uint16_t pmem_read(const uint16_t paddr) const
 		{
-			return this->memory[paddr];
+			mylib_assert_exception(paddr < this->machine.memsize_words) return this->pmem[paddr];
 		}
 
 		inline void pmem_write(const uint16_t paddr, const uint16_t value)
 		{
-			this->memory[paddr] = value;
+			mylib_assert_exception(paddr < this->machine.memsize_words) this->pmem[paddr] = value;
 		}
 
-		inline uint32_t translate(PageTable *page_table, uint32_t virtual_address)
+		// direct access to a physical range, used by the kernel for bulk copies
+		inline uint16_t *pmem_span(const uint32_t paddr, const uint32_t len)
 		{
-			uint32_t page_number = virtual_address >> 4;
-			uint32_t offset = virtual_address & (Config::page_size_words - 1);
+			mylib_assert_exception(paddr + len <= this->machine.memsize_words) return this->pmem + paddr;
+		}
+
+		bool interrupt(const InterruptCode interrupt_code);
+		void force_interrupt(const InterruptCode interrupt_code);
+		void turn_off();
+
+	protected:
+		inline void tlb_insert(const uint32_t page_number, const uint32_t frame_number, const bool large)
+		{
+			this->tlb[this->tlb_next] = {page_number, frame_number, large, true};
+			this->tlb_next = (this->tlb_next + 1) % this->tlb.size();
+		}
+	};
+
+	// ---------------------------------------
+
+	// cpu specialized for machine M, its parameters are constants in the fetch, execute and translate paths
+	template <typename M>
+	class CpuModel final : public Cpu
+	{
+	private:
+		using SmallPage = PageGeometry<M::page_shift>;
+
+		static inline constexpr uint32_t frames_per_large_page = LargePage::size_words / SmallPage::size_words;
+
+		Memory<M> &memory;
+
+	public:
+		CpuModel(Memory<M> &memory);
+
+		void run_cycle() override;
+
+		inline uint32_t translate(PageTable *page_table, const uint32_t virtual_address) override
+		{
+			const bool cached = (page_table == this->page_table);
+
+			if (cached)
+			{
+				for (const TlbEntry &entry : this->tlb)
+				{
+					if (!entry.valid)
+						continue;
+
+					if (entry.large ? (entry.page_number == LargePage::number(virtual_address)) : (entry.page_number == SmallPage::number(virtual_address)))
+					{
+						this->tlb_hits++;
+						return entry.large ? address<LargePage>(entry.frame_number, virtual_address) : address<SmallPage>(entry.frame_number, virtual_address);
+					}
+				}
+
+				this->tlb_misses++;
+			}
+
+			if constexpr (Config::large_pages)
+			{
+				const uint32_t large_number = LargePage::number(virtual_address);
+
+				if (large_number < page_table->large_frames.size() && page_table->large_frames[large_number].valid)
+				{
+					const uint32_t frame_number = page_table->large_frames[large_number].frame_number;
+
+					if (cached)
+						this->tlb_insert(large_number, frame_number, true);
+
+					return address<LargePage>(frame_number, virtual_address);
+				}
+			}
+
+			const uint32_t page_number = SmallPage::number(virtual_address);
 
 			if (page_number >= page_table->frames.size() || !page_table->frames[page_number].valid)
 			{
 				this->force_interrupt(InterruptCode::GPF);
 			}
+			else if (cached)
+				this->tlb_insert(page_number, page_table->frames[page_number].frame_number, false);
 
 			uint32_t frame_number = page_table->frames[page_number].frame_number;
-			return (frame_number << 4) + offset;
+			return address<SmallPage>(frame_number, virtual_address);
 		}
 
-		bool interrupt(const InterruptCode interrupt_code);
-		void force_interrupt(const InterruptCode interrupt_code);
-		void turn_off();
-
 	private:
+		// frame_number is given in frames of the small page size
+		template <typename Page>
+		static inline uint32_t address(const uint32_t frame_number, const uint32_t vaddr)
+		{
+			return (frame_number << M::page_shift) + Page::offset(vaddr);
+		}
+
+		// registers above the ones of the machine raise a GPF
+		inline bool valid_regs(const uint16_t a, const uint16_t b = 0, const uint16_t c = 0)
+		{
+			if constexpr (M::nregs < Config::max_nregs)
+			{
+				if (a >= M::nregs || b >= M::nregs || c >= M::nregs)
+				{
+					this->force_interrupt(InterruptCode::GPF);
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		// vector instructions only check their general purpose register fields, every vector register exists
+		inline bool valid_regs(const OpcodeR opcode, const uint16_t dest, const uint16_t op1, const uint16_t op2)
+		{
+			if constexpr (M::nregs < Config::max_nregs)
+			{
+				if (!valid_fields(opcode, dest, op1, op2, M::nregs))
+				{
+					this->force_interrupt(InterruptCode::GPF);
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		// verified instructions skip the register and opcode checks
+		template <bool verified>
 		void execute_r(const Mylib::BitSet<16> instruction);
+
+		template <bool verified>
 		void execute_i(const Mylib::BitSet<16> instruction);
 
 		inline uint16_t vmem_read(const uint16_t vaddr)
@@ -270,7 +650,7 @@ namespace Arch
 			try
 			{
 				const uint16_t paddr = translate(this->page_table, vaddr);
-				return this->pmem_read(paddr);
+				return this->memory[paddr];
 			}
 			catch (const Mylib::Exception &e)
 			{
@@ -279,12 +659,77 @@ namespace Arch
 			}
 		}
 
+		// fetching from a page without the executable bit raises a GPF
+		inline uint16_t vmem_fetch(const uint16_t vaddr, bool &verified)
+		{
+			const uint32_t page_number = SmallPage::number(vaddr);
+			verified = false;
+
+			if (page_number < this->page_table->frames.size() && this->page_table->frames[page_number].valid)
+			{
+				const PageTableBase &entry = this->page_table->frames[page_number];
+
+				if (!entry.executable)
+				{
+					this->force_interrupt(InterruptCode::GPF);
+					return 0;
+				}
+
+				verified = entry.verified;
+			}
+
+			return this->vmem_read(vaddr);
+		}
+
+		// returns false if the store must raise a GPF
+		bool check_write_access(const uint16_t vaddr);
+
+		// Calls fn(a, b, n) with the physical words of each piece of [a, a + len) and [b, b + len)
+		// that stays inside one page of both ranges, so a block instruction translates once per page.
+		// Raises a GPF at the first page that cannot be accessed, the pieces before it are done.
+		// fn returns false to stop early.
+		template <typename T>
+		inline void for_each_block_run(uint32_t a, uint32_t b, uint32_t len, const bool write_a, T fn)
+		{
+			while (len > 0)
+			{
+				const uint32_t n = std::min({len, SmallPage::size_words - SmallPage::offset(a), SmallPage::size_words - SmallPage::offset(b)});
+
+				if (a >= Config::virtual_space_size || b >= Config::virtual_space_size || (write_a && !this->check_write_access(a)))
+				{
+					this->force_interrupt(InterruptCode::GPF);
+					return;
+				}
+
+				const uint32_t paddr_a = this->translate(this->page_table, a);
+				if (this->has_interrupt)
+					return;
+
+				const uint32_t paddr_b = this->translate(this->page_table, b);
+				if (this->has_interrupt)
+					return;
+
+				if (!fn(this->pmem + paddr_a, this->pmem + paddr_b, n))
+					return;
+
+				a += n;
+				b += n;
+				len -= n;
+			}
+		}
+
 		inline void vmem_write(const uint16_t vaddr, const uint16_t value)
 		{
 			try
 			{
+				if (!this->check_write_access(vaddr))
+				{
+					this->force_interrupt(InterruptCode::GPF);
+					return;
+				}
+
 				const uint16_t paddr = translate(this->page_table, vaddr);
-				this->pmem_write(paddr, value);
+				this->memory[paddr] = value;
 			}
 			catch (const Mylib::Exception &e)
 			{
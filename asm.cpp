@@ -0,0 +1,1352 @@
+#include <sstream>
+#include <iomanip>
+#include <array>
+#include <utility>
+#include <map>
+#include <set>
+#include <optional>
+#include <algorithm>
+
+#include <cctype>
+
+#include <my-lib/std.h>
+#include <my-lib/macros.h>
+
+#include "arq-sim.h"
+#include "asm.h"
+
+namespace Asm
+{
+
+	// ---------------------------------------
+
+	enum class Op : uint8_t
+	{
+		Add,
+		Sub,
+		Mul,
+		Div,
+		Cmp_equal,
+		Cmp_neq,
+		Load,
+		Store,
+		Copy_block,
+		Fill_block,
+		Cmp_block,
+		Vload,
+		Vstore,
+		Vadd,
+		Vsub,
+		Vmul,
+		Vcmp_equal,
+		Vsplat,
+		Vsum,
+		Syscall,
+		Jump,
+		Jump_cond,
+		Mov,
+		Copy // register to register mov, removed or expanded once registers are allocated
+	};
+
+	struct OpInfo
+	{
+		const char *name;
+		bool r_type;
+		uint16_t opcode;
+	};
+
+	static constexpr auto op_info = std::to_array<OpInfo>({
+		{"add", true, std::to_underlying(Arch::OpcodeR::Add)},
+		{"sub", true, std::to_underlying(Arch::OpcodeR::Sub)},
+		{"mul", true, std::to_underlying(Arch::OpcodeR::Mul)},
+		{"div", true, std::to_underlying(Arch::OpcodeR::Div)},
+		{"cmp_equal", true, std::to_underlying(Arch::OpcodeR::Cmp_equal)},
+		{"cmp_neq", true, std::to_underlying(Arch::OpcodeR::Cmp_neq)},
+		{"load", true, std::to_underlying(Arch::OpcodeR::Load)},
+		{"store", true, std::to_underlying(Arch::OpcodeR::Store)},
+		{"copy_block", true, std::to_underlying(Arch::OpcodeR::Copy_block)},
+		{"fill_block", true, std::to_underlying(Arch::OpcodeR::Fill_block)},
+		{"cmp_block", true, std::to_underlying(Arch::OpcodeR::Cmp_block)},
+		{"vload", true, std::to_underlying(Arch::OpcodeR::Vload)},
+		{"vstore", true, std::to_underlying(Arch::OpcodeR::Vstore)},
+		{"vadd", true, std::to_underlying(Arch::OpcodeR::Vadd)},
+		{"vsub", true, std::to_underlying(Arch::OpcodeR::Vsub)},
+		{"vmul", true, std::to_underlying(Arch::OpcodeR::Vmul)},
+		{"vcmp_equal", true, std::to_underlying(Arch::OpcodeR::Vcmp_equal)},
+		{"vsplat", true, std::to_underlying(Arch::OpcodeR::Vsplat)},
+		{"vsum", true, std::to_underlying(Arch::OpcodeR::Vsum)},
+		{"syscall", true, std::to_underlying(Arch::OpcodeR::Syscall)},
+		{"jump", false, std::to_underlying(Arch::OpcodeI::Jump)},
+		{"jump_cond", false, std::to_underlying(Arch::OpcodeI::Jump_cond)},
+		{"mov", false, std::to_underlying(Arch::OpcodeI::Mov)},
+		{"copy", false, 0}
+	});
+
+	static inline const OpInfo &info(const Op op)
+	{
+		return op_info[std::to_underlying(op)];
+	}
+
+	static inline bool is_alu(const Op op)
+	{
+		return op <= Op::Cmp_neq;
+	}
+
+	static inline bool is_vector_alu(const Op op)
+	{
+		return op >= Op::Vadd && op <= Op::Vcmp_equal;
+	}
+
+	// false for the fields of the encoding that name vector registers
+	static inline bool is_scalar_field(const Op op, const uint32_t field)
+	{
+		return !info(op).r_type || (Arch::scalar_fields(static_cast<Arch::OpcodeR>(info(op).opcode)) & (0b100 >> field));
+	}
+
+	inline constexpr uint32_t max_immediate = (1 << 9) - 1;
+
+	// ---------------------------------------
+
+	// values below Config::max_nregs are registers, the following ones are variables
+	using Value = uint32_t;
+
+	struct Item
+	{
+		enum class Kind
+		{
+			Label,
+			Instr,
+			Word
+		};
+
+		Kind kind;
+		Op op = Op::Add;
+
+		// as in the encoding: dest, op1, op2
+		// store uses op1 as the address and op2 as the value, jump_cond and mov use regs[0]
+		// the vector register fields hold the number of the vector register
+		std::array<Value, 3> regs = {0, 0, 0};
+
+		uint16_t imm = 0;   // mov immediate, word, or registers after r0 read by a syscall
+		std::string symbol; // label defined, or label jumped to or moved
+		uint32_t line;
+		bool deleted = false;
+	};
+
+	struct Program
+	{
+		std::vector<Item> items;
+		std::vector<std::string> names; // of every value
+		std::map<std::string, Value, std::less<>> variables;
+		std::map<std::string, uint16_t, std::less<>> constants;
+		std::set<std::string, std::less<>> labels;
+		uint32_t line = 0;
+		uint32_t temps = 0;
+	};
+
+	// ---------------------------------------
+
+	static inline bool is_variable(const Value v)
+	{
+		return v >= Config::max_nregs;
+	}
+
+	static std::optional<Value> def(const Item &item)
+	{
+		if (item.kind != Item::Kind::Instr)
+			return std::nullopt;
+
+		if (is_alu(item.op) || item.op == Op::Load || item.op == Op::Cmp_block || item.op == Op::Vsum || item.op == Op::Mov || item.op == Op::Copy)
+			return item.regs[0];
+
+		if (item.op == Op::Syscall)
+			return 1;
+
+		return std::nullopt;
+	}
+
+	static void uses(const Item &item, std::vector<Value> &out)
+	{
+		out.clear();
+
+		if (item.kind != Item::Kind::Instr)
+			return;
+
+		if (is_alu(item.op))
+			out = {item.regs[1], item.regs[2]};
+		else if (item.op == Op::Load || item.op == Op::Copy || item.op == Op::Vload || item.op == Op::Vstore || item.op == Op::Vsplat)
+			out = {item.regs[1]};
+		else if (item.op == Op::Store)
+			out = {item.regs[1], item.regs[2]};
+		else if (item.op == Op::Copy_block || item.op == Op::Fill_block || item.op == Op::Cmp_block)
+			out = {item.regs[0], item.regs[1], item.regs[2]};
+		else if (item.op == Op::Jump_cond)
+			out = {item.regs[0]};
+		else if (item.op == Op::Syscall)
+		{
+			for (Value r = 0; r <= item.imm; r++)
+				out.push_back(r);
+		}
+	}
+
+	// ---------------------------------------
+
+	[[noreturn]] static void error(const Program &p, const std::string_view msg)
+	{
+		throw Mylib::Exception(Mylib::build_str_from_stream("line ", p.line, ": ", msg));
+	}
+
+	static std::string_view trim(std::string_view s)
+	{
+		while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front())))
+			s.remove_prefix(1);
+		while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back())))
+			s.remove_suffix(1);
+		return s;
+	}
+
+	static bool is_identifier(const std::string_view s)
+	{
+		if (s.empty() || !(std::isalpha(static_cast<unsigned char>(s[0])) || s[0] == '_' || s[0] == '.'))
+			return false;
+
+		return std::all_of(s.begin(), s.end(), [] (const char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.'; });
+	}
+
+	// cuts the comment, keeping ; inside strings
+	static std::string_view strip_comment(const std::string_view line)
+	{
+		bool quoted = false;
+
+		for (uint32_t i = 0; i < line.size(); i++)
+		{
+			if (line[i] == '"')
+				quoted = !quoted;
+			else if (line[i] == ';' && !quoted)
+				return line.substr(0, i);
+		}
+
+		return line;
+	}
+
+	static std::vector<std::string_view> split_operands(std::string_view s)
+	{
+		std::vector<std::string_view> operands;
+
+		while (!(s = trim(s)).empty())
+		{
+			const size_t comma = s.find(',');
+			operands.push_back(trim(s.substr(0, comma)));
+			s = (comma == std::string_view::npos) ? std::string_view() : s.substr(comma + 1);
+		}
+
+		return operands;
+	}
+
+	static std::optional<uint16_t> parse_number(const Program &p, const std::string_view s)
+	{
+		if (s.size() == 3 && s.front() == '\'' && s.back() == '\'')
+			return static_cast<uint16_t>(s[1]);
+
+		if (s.empty() || !std::isdigit(static_cast<unsigned char>(s[0])))
+		{
+			if (const auto it = p.constants.find(s); it != p.constants.end())
+				return it->second;
+			return std::nullopt;
+		}
+
+		size_t end;
+		unsigned long v;
+
+		try
+		{
+			v = std::stoul(std::string(s), &end, 0);
+		}
+		catch (const std::exception &)
+		{
+			error(p, "invalid number " + std::string(s));
+		}
+
+		if (end != s.size() || v > UINT16_MAX)
+			error(p, "invalid number " + std::string(s));
+
+		return static_cast<uint16_t>(v);
+	}
+
+	static std::optional<Value> parse_register(Program &p, std::string_view s)
+	{
+		if (s.size() == 2 && s[0] == 'r' && s[1] >= '0' && s[1] < '0' + static_cast<char>(Config::max_nregs))
+			return s[1] - '0';
+
+		// vector register names are not variables
+		if (s.size() == 2 && s[0] == 'v' && std::isdigit(static_cast<unsigned char>(s[1])))
+			return std::nullopt;
+
+		if (!is_identifier(s) || p.labels.contains(s) || p.constants.contains(s))
+			return std::nullopt;
+
+		if (const auto it = p.variables.find(s); it != p.variables.end())
+			return it->second;
+
+		const Value v = p.names.size();
+		p.names.emplace_back(s);
+		p.variables.emplace(s, v);
+
+		return v;
+	}
+
+	static Value new_temp(Program &p)
+	{
+		const Value v = p.names.size();
+		p.names.push_back(".t" + std::to_string(p.temps++));
+		return v;
+	}
+
+	static Item &emit(Program &p, const Op op, const Value dest = 0, const Value op1 = 0, const Value op2 = 0)
+	{
+		p.items.push_back({.kind = Item::Kind::Instr, .op = op, .regs = {dest, op1, op2}, .line = p.line});
+		return p.items.back();
+	}
+
+	// values above max_immediate are built as hi * 256 + lo
+	static void emit_mov_imm(Program &p, const Value dest, const uint16_t v)
+	{
+		if (v <= max_immediate)
+		{
+			emit(p, Op::Mov, dest).imm = v;
+			return;
+		}
+
+		const Value t = new_temp(p);
+
+		emit(p, Op::Mov, dest).imm = v >> 8;
+		emit(p, Op::Mov, t).imm = 256;
+		emit(p, Op::Mul, dest, dest, t);
+
+		if (v & 0xFF)
+		{
+			emit(p, Op::Mov, t).imm = v & 0xFF;
+			emit(p, Op::Add, dest, dest, t);
+		}
+	}
+
+	// moves any source operand into dest
+	static void emit_mov(Program &p, const Value dest, const std::string_view s)
+	{
+		if (const auto v = parse_number(p, s))
+			emit_mov_imm(p, dest, *v);
+		else if (p.labels.contains(s))
+			emit(p, Op::Mov, dest).symbol = s;
+		else if (const auto r = parse_register(p, s))
+			emit(p, Op::Copy, dest, *r);
+		else
+			error(p, "invalid operand " + std::string(s));
+	}
+
+	// a register operand, or a temporary holding any other source operand
+	static Value source(Program &p, const std::string_view s)
+	{
+		if (const auto r = parse_register(p, s))
+			return *r;
+
+		const Value t = new_temp(p);
+		emit_mov(p, t, s);
+
+		return t;
+	}
+
+	static Value destination(Program &p, const std::string_view s)
+	{
+		if (const auto r = parse_register(p, s))
+			return *r;
+
+		error(p, "invalid destination " + std::string(s));
+	}
+
+	static Value vector_register(const Program &p, const std::string_view s)
+	{
+		if (s.size() == 2 && s[0] == 'v' && s[1] >= '0' && s[1] < '0' + static_cast<char>(Config::vector_regs))
+			return s[1] - '0';
+
+		error(p, "expected a vector register, found " + std::string(s));
+	}
+
+	static Op find_op(const std::string_view mnemonic)
+	{
+		return static_cast<Op>(std::find_if(op_info.begin(), op_info.end(), [mnemonic] (const OpInfo &i) { return mnemonic == i.name; }) - op_info.begin());
+	}
+
+	static std::string_view address_operand(const Program &p, const std::string_view s)
+	{
+		if (s.size() < 2 || s.front() != '[' || s.back() != ']')
+			error(p, "expected [address], found " + std::string(s));
+
+		return trim(s.substr(1, s.size() - 2));
+	}
+
+	// arguments after r0 of each service of OS::syscall, unknown ones are given r1 to r3
+	static constexpr auto syscall_args = std::to_array<uint8_t>({
+		0, 1, 0, 1, 3, 3, 1, 0, 0, 1,
+		0, 2, 0, 3, 3, 1, 0, 3, 3, 1,
+		2, 2, 1, 2, 2, 0, 2, 0, 2, 3,
+		3, 1
+	});
+
+	// looks for the mov of the service number in r0 earlier in the block
+	static uint16_t syscall_uses(const Program &p)
+	{
+		for (auto it = p.items.rbegin(); it != p.items.rend(); ++it)
+		{
+			if (it->kind != Item::Kind::Instr || it->op == Op::Jump || it->op == Op::Jump_cond || it->op == Op::Syscall)
+				break;
+
+			if (def(*it) == 0)
+				return (it->op == Op::Mov && it->symbol.empty() && it->imm < syscall_args.size()) ? syscall_args[it->imm] : 3;
+		}
+
+		return 3;
+	}
+
+	static void parse_statement(Program &p, const std::string_view mnemonic, const std::string_view rest)
+	{
+		const std::vector<std::string_view> operands = split_operands(rest);
+
+		const auto expect = [&p, &operands, mnemonic] (const uint32_t n) {
+			if (operands.size() != n)
+				error(p, std::string(mnemonic) + " takes " + std::to_string(n) + " operands");
+		};
+
+		if (mnemonic == ".word")
+		{
+			for (const std::string_view s : operands)
+			{
+				const auto v = parse_number(p, s);
+
+				if (!v)
+					error(p, "invalid word " + std::string(s));
+
+				p.items.push_back({.kind = Item::Kind::Word, .imm = *v, .line = p.line});
+			}
+		}
+		else if (mnemonic == ".string")
+		{
+			const std::string_view s = trim(rest);
+
+			if (s.size() < 2 || s.front() != '"' || s.back() != '"')
+				error(p, "expected a quoted string");
+
+			for (const char c : s.substr(1, s.size() - 2))
+				p.items.push_back({.kind = Item::Kind::Word, .imm = static_cast<uint16_t>(c), .line = p.line});
+
+			p.items.push_back({.kind = Item::Kind::Word, .imm = 0, .line = p.line});
+		}
+		else if (mnemonic == ".const")
+		{
+			const std::string_view s = trim(rest);
+			const size_t space = s.find_first_of(" \t");
+			const std::string_view name = s.substr(0, space);
+			const auto v = (space == std::string_view::npos) ? std::nullopt : parse_number(p, trim(s.substr(space)));
+
+			if (!is_identifier(name) || p.labels.contains(name) || p.variables.contains(name) || !v)
+				error(p, ".const takes a new name and a number");
+
+			p.constants[std::string(name)] = *v;
+		}
+		else if (mnemonic == "add" || mnemonic == "sub" || mnemonic == "mul" || mnemonic == "div" || mnemonic == "cmp_equal" || mnemonic == "cmp_neq")
+		{
+			expect(3);
+
+			const Op op = find_op(mnemonic);
+			const Value op1 = source(p, operands[1]);
+			const Value op2 = source(p, operands[2]);
+
+			emit(p, op, destination(p, operands[0]), op1, op2);
+		}
+		else if (mnemonic == "load")
+		{
+			expect(2);
+			const Value address = source(p, address_operand(p, operands[1]));
+			emit(p, Op::Load, destination(p, operands[0]), address);
+		}
+		else if (mnemonic == "copy_block" || mnemonic == "fill_block")
+		{
+			expect(3);
+			const Value dest = source(p, operands[0]);
+			const Value op1 = source(p, operands[1]);
+			emit(p, (mnemonic == "copy_block") ? Op::Copy_block : Op::Fill_block, dest, op1, source(p, operands[2]));
+		}
+		else if (mnemonic == "cmp_block")
+		{
+			expect(3);
+			const Value op1 = source(p, operands[1]);
+			const Value op2 = source(p, operands[2]);
+			emit(p, Op::Cmp_block, destination(p, operands[0]), op1, op2);
+		}
+		else if (mnemonic == "store")
+		{
+			expect(2);
+			const Value address = source(p, address_operand(p, operands[0]));
+			emit(p, Op::Store, 0, address, source(p, operands[1]));
+		}
+		else if (mnemonic == "vadd" || mnemonic == "vsub" || mnemonic == "vmul" || mnemonic == "vcmp_equal")
+		{
+			expect(3);
+			emit(p, find_op(mnemonic), vector_register(p, operands[0]), vector_register(p, operands[1]), vector_register(p, operands[2]));
+		}
+		else if (mnemonic == "vload")
+		{
+			expect(2);
+			const Value address = source(p, address_operand(p, operands[1]));
+			emit(p, Op::Vload, vector_register(p, operands[0]), address);
+		}
+		else if (mnemonic == "vstore")
+		{
+			expect(2);
+			const Value address = source(p, address_operand(p, operands[0]));
+			emit(p, Op::Vstore, 0, address, vector_register(p, operands[1]));
+		}
+		else if (mnemonic == "vsplat")
+		{
+			expect(2);
+			const Value value = source(p, operands[1]);
+			emit(p, Op::Vsplat, vector_register(p, operands[0]), value);
+		}
+		else if (mnemonic == "vsum")
+		{
+			expect(2);
+			emit(p, Op::Vsum, destination(p, operands[0]), vector_register(p, operands[1]));
+		}
+		else if (mnemonic == "mov")
+		{
+			expect(2);
+			emit_mov(p, destination(p, operands[0]), operands[1]);
+		}
+		else if (mnemonic == "jump" || mnemonic == "jump_cond")
+		{
+			const bool cond = (mnemonic == "jump_cond");
+			expect(cond ? 2 : 1);
+
+			const std::string_view target = operands.back();
+
+			if (!p.labels.contains(target))
+				error(p, "unknown label " + std::string(target));
+
+			emit(p, cond ? Op::Jump_cond : Op::Jump, cond ? source(p, operands[0]) : 0).symbol = target;
+		}
+		else if (mnemonic == "syscall")
+		{
+			expect(0);
+			const uint16_t args = syscall_uses(p);
+			emit(p, Op::Syscall).imm = args;
+		}
+		else
+			error(p, "unknown instruction " + std::string(mnemonic));
+	}
+
+	static void parse(Program &p, const std::string_view source)
+	{
+		for (uint32_t i = 0; i < Config::max_nregs; i++)
+			p.names.push_back("r" + std::to_string(i));
+
+		std::vector<std::string_view> lines;
+
+		for (size_t pos = 0; pos <= source.size();)
+		{
+			const size_t end = std::min(source.find('\n', pos), source.size());
+			lines.push_back(source.substr(pos, end - pos));
+			pos = end + 1;
+		}
+
+		// labels first, jumps and movs may refer to the ones below them
+		for (const std::string_view line : lines)
+		{
+			const std::string_view s = trim(strip_comment(line));
+			const size_t colon = s.find(':');
+
+			p.line++;
+
+			if (colon != std::string_view::npos && is_identifier(trim(s.substr(0, colon))) && !p.labels.emplace(trim(s.substr(0, colon))).second)
+				error(p, "label " + std::string(trim(s.substr(0, colon))) + " defined twice");
+		}
+
+		p.line = 0;
+
+		for (const std::string_view line : lines)
+		{
+			p.line++;
+
+			std::string_view s = trim(strip_comment(line));
+			const size_t colon = s.find(':');
+
+			if (colon != std::string_view::npos && is_identifier(trim(s.substr(0, colon))))
+			{
+				p.items.push_back({.kind = Item::Kind::Label, .symbol = std::string(trim(s.substr(0, colon))), .line = p.line});
+				s = trim(s.substr(colon + 1));
+			}
+
+			if (s.empty())
+				continue;
+
+			const size_t space = s.find_first_of(" \t");
+			const std::string_view mnemonic = s.substr(0, space);
+
+			parse_statement(p, mnemonic, space == std::string_view::npos ? std::string_view() : s.substr(space));
+		}
+	}
+
+	// ---------------------------------------
+
+	static std::map<std::string, uint32_t, std::less<>> label_indices(const Program &p)
+	{
+		std::map<std::string, uint32_t, std::less<>> indices;
+
+		for (uint32_t i = 0; i < p.items.size(); i++)
+		{
+			if (p.items[i].kind == Item::Kind::Label)
+				indices[p.items[i].symbol] = i;
+		}
+
+		return indices;
+	}
+
+	static std::vector<std::vector<uint32_t>> successors(const Program &p)
+	{
+		const auto labels = label_indices(p);
+		std::vector<std::vector<uint32_t>> succ(p.items.size());
+
+		for (uint32_t i = 0; i < p.items.size(); i++)
+		{
+			const Item &item = p.items[i];
+			const bool jump = (item.kind == Item::Kind::Instr && (item.op == Op::Jump || item.op == Op::Jump_cond));
+
+			if (!(jump && item.op == Op::Jump) && i + 1 < p.items.size())
+				succ[i].push_back(i + 1);
+
+			if (jump)
+				succ[i].push_back(labels.at(item.symbol));
+		}
+
+		return succ;
+	}
+
+	static void erase_deleted(Program &p)
+	{
+		std::erase_if(p.items, [] (const Item &item) { return item.deleted; });
+	}
+
+	// labels that control can reach other than by falling through
+	static std::set<std::string, std::less<>> jump_targets(const Program &p)
+	{
+		std::set<std::string, std::less<>> targets;
+
+		for (const Item &item : p.items)
+		{
+			if (item.kind == Item::Kind::Instr && (item.op == Op::Jump || item.op == Op::Jump_cond))
+				targets.insert(item.symbol);
+		}
+
+		return targets;
+	}
+
+	static std::optional<uint16_t> evaluate(const Op op, const uint16_t a, const uint16_t b)
+	{
+		switch (op)
+		{
+			case Op::Add: return a + b;
+			case Op::Sub: return a - b;
+			case Op::Mul: return a * b;
+			case Op::Div: return b ? std::optional<uint16_t>(a / b) : std::nullopt;
+			case Op::Cmp_equal: return a == b;
+			case Op::Cmp_neq: return a != b;
+			default: return std::nullopt;
+		}
+	}
+
+	// Tracks the constants held by registers and variables along each basic block,
+	// replacing computations on them by movs, dropping movs of values already there
+	// and resolving conditional jumps on constants.
+	static bool fold_constants(Program &p)
+	{
+		const auto targets = jump_targets(p);
+		std::map<Value, uint16_t> known;
+		bool changed = false;
+
+		const auto value = [&known] (const Value v) -> std::optional<uint16_t> {
+			const auto it = known.find(v);
+			return (it == known.end()) ? std::nullopt : std::optional<uint16_t>(it->second);
+		};
+
+		for (Item &item : p.items)
+		{
+			if (item.kind == Item::Kind::Label)
+			{
+				if (targets.contains(item.symbol))
+					known.clear();
+				continue;
+			}
+
+			if (item.kind == Item::Kind::Word)
+			{
+				known.clear();
+				continue;
+			}
+
+			const Value dest = item.regs[0];
+
+			switch (item.op)
+			{
+				case Op::Add: case Op::Sub: case Op::Mul: case Op::Div: case Op::Cmp_equal: case Op::Cmp_neq:
+				{
+					const auto a = value(item.regs[1]);
+					const auto b = value(item.regs[2]);
+					const auto v = (a && b) ? evaluate(item.op, *a, *b) : std::nullopt;
+
+					if (v && *v <= max_immediate)
+					{
+						item = {.kind = Item::Kind::Instr, .op = Op::Mov, .regs = {dest, 0, 0}, .imm = *v, .line = item.line};
+						changed = true;
+					}
+
+					if (v)
+						known[dest] = *v;
+					else
+						known.erase(dest);
+				}
+				break;
+
+				case Op::Mov:
+					if (!item.symbol.empty())
+						known.erase(dest);
+					else if (value(dest) == item.imm)
+					{
+						item.deleted = true;
+						changed = true;
+					}
+					else
+						known[dest] = item.imm;
+				break;
+
+				case Op::Copy:
+					if (dest == item.regs[1])
+					{
+						item.deleted = true;
+						changed = true;
+					}
+					else if (const auto v = value(item.regs[1]); v && *v <= max_immediate)
+					{
+						item = {.kind = Item::Kind::Instr, .op = Op::Mov, .regs = {dest, 0, 0}, .imm = *v, .line = item.line};
+						known[dest] = *v;
+						changed = true;
+					}
+					else if (v)
+						known[dest] = *v;
+					else
+						known.erase(dest);
+				break;
+
+				case Op::Load:
+				case Op::Cmp_block:
+				case Op::Vsum:
+					known.erase(dest);
+				break;
+
+				case Op::Syscall:
+					known.erase(1);
+				break;
+
+				case Op::Jump_cond:
+					if (const auto v = value(item.regs[0]))
+					{
+						if (*v == 1)
+							item.op = Op::Jump;
+						else
+							item.deleted = true;
+						changed = true;
+					}
+				break;
+
+				case Op::Jump:
+					known.clear();
+				break;
+
+				case Op::Store:
+				case Op::Copy_block:
+				case Op::Fill_block:
+				case Op::Vload: case Op::Vstore: case Op::Vadd: case Op::Vsub: case Op::Vmul: case Op::Vcmp_equal: case Op::Vsplat:
+				break;
+			}
+		}
+
+		erase_deleted(p);
+
+		return changed;
+	}
+
+	// retargets jumps to jumps at their final destination, and removes jumps to the next instruction
+	static bool thread_jumps(Program &p)
+	{
+		const auto labels = label_indices(p);
+		bool changed = false;
+
+		// first item after i that is not a label
+		const auto next = [&p] (uint32_t i) {
+			for (i++; i < p.items.size() && p.items[i].kind == Item::Kind::Label; i++)
+				;
+			return i;
+		};
+
+		for (uint32_t i = 0; i < p.items.size(); i++)
+		{
+			Item &item = p.items[i];
+
+			if (item.kind != Item::Kind::Instr || (item.op != Op::Jump && item.op != Op::Jump_cond))
+				continue;
+
+			for (uint32_t hops = 0; hops < p.items.size(); hops++)
+			{
+				const uint32_t j = next(labels.at(item.symbol));
+
+				if (j == i || j >= p.items.size() || p.items[j].kind != Item::Kind::Instr || p.items[j].op != Op::Jump || p.items[j].symbol == item.symbol)
+					break;
+
+				item.symbol = p.items[j].symbol;
+				changed = true;
+			}
+
+			if (next(i) == next(labels.at(item.symbol)))
+			{
+				item.deleted = true;
+				changed = true;
+			}
+		}
+
+		erase_deleted(p);
+
+		return changed;
+	}
+
+	// instructions no path from the entry reaches, data is always kept
+	static bool remove_unreachable(Program &p)
+	{
+		if (p.items.empty())
+			return false;
+
+		const auto succ = successors(p);
+		std::vector<bool> reached(p.items.size(), false);
+		std::vector<uint32_t> stack = {0};
+		bool changed = false;
+
+		reached[0] = true;
+
+		while (!stack.empty())
+		{
+			const uint32_t i = stack.back();
+			stack.pop_back();
+
+			for (const uint32_t j : succ[i])
+			{
+				if (!reached[j])
+				{
+					reached[j] = true;
+					stack.push_back(j);
+				}
+			}
+		}
+
+		for (uint32_t i = 0; i < p.items.size(); i++)
+		{
+			if (!reached[i] && p.items[i].kind == Item::Kind::Instr)
+			{
+				p.items[i].deleted = true;
+				changed = true;
+			}
+		}
+
+		erase_deleted(p);
+
+		return changed;
+	}
+
+	struct Liveness
+	{
+		std::vector<std::set<Value>> in;
+		std::vector<std::set<Value>> out;
+	};
+
+	static Liveness liveness(const Program &p)
+	{
+		const auto succ = successors(p);
+		Liveness live = {std::vector<std::set<Value>>(p.items.size()), std::vector<std::set<Value>>(p.items.size())};
+		std::vector<Value> used;
+		bool changed = true;
+
+		while (changed)
+		{
+			changed = false;
+
+			for (uint32_t i = p.items.size(); i-- > 0;)
+			{
+				std::set<Value> out;
+
+				for (const uint32_t j : succ[i])
+					out.insert(live.in[j].begin(), live.in[j].end());
+
+				std::set<Value> in = out;
+
+				if (const auto d = def(p.items[i]))
+					in.erase(*d);
+
+				uses(p.items[i], used);
+				in.insert(used.begin(), used.end());
+
+				if (in != live.in[i] || out != live.out[i])
+				{
+					live.in[i] = std::move(in);
+					live.out[i] = std::move(out);
+					changed = true;
+				}
+			}
+		}
+
+		return live;
+	}
+
+	// computations of variables that are never read
+	// memory reads are kept, they may fault, registers are kept, syscalls read them
+	static bool remove_dead_results(Program &p)
+	{
+		const Liveness live = liveness(p);
+		bool changed = false;
+
+		for (uint32_t i = 0; i < p.items.size(); i++)
+		{
+			Item &item = p.items[i];
+			const auto d = def(item);
+
+			if (d && is_variable(*d) && item.op != Op::Load && item.op != Op::Cmp_block && item.op != Op::Syscall && !live.out[i].contains(*d))
+			{
+				item.deleted = true;
+				changed = true;
+			}
+		}
+
+		erase_deleted(p);
+
+		return changed;
+	}
+
+	static void optimize(Program &p)
+	{
+		bool changed = true;
+
+		while (changed)
+		{
+			changed = fold_constants(p);
+			changed |= thread_jumps(p);
+			changed |= remove_unreachable(p);
+			changed |= remove_dead_results(p);
+		}
+	}
+
+	// ---------------------------------------
+
+	static const char *reg_name(const Value r)
+	{
+		static constexpr auto names = std::to_array<const char *>({"r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7"});
+		static_assert(names.size() == Config::max_nregs);
+
+		return names[r];
+	}
+
+	static const char *vreg_name(const Value v)
+	{
+		static constexpr auto names = std::to_array<const char *>({"v0", "v1", "v2", "v3", "v4", "v5", "v6", "v7"});
+		static_assert(names.size() == Config::vector_regs);
+
+		return names[v];
+	}
+
+	// Colors the interference graph of the variables greedily, most constrained first,
+	// preferring the register of a copy source or destination so the copy disappears.
+	static void allocate_registers(Program &p, const uint32_t nregs)
+	{
+		const Liveness live = liveness(p);
+		std::vector<std::set<Value>> interferes(p.names.size());
+		std::vector<std::set<Value>> copies(p.names.size());
+
+		const auto edge = [&interferes] (const Value a, const Value b) {
+			if (a != b)
+			{
+				interferes[a].insert(b);
+				interferes[b].insert(a);
+			}
+		};
+
+		for (uint32_t i = 0; i < p.items.size(); i++)
+		{
+			const Item &item = p.items[i];
+			const auto d = def(item);
+
+			if (!d)
+				continue;
+
+			for (const Value v : live.out[i])
+			{
+				if (!(item.op == Op::Copy && v == item.regs[1]))
+					edge(*d, v);
+			}
+
+			if (item.op == Op::Copy)
+			{
+				copies[item.regs[0]].insert(item.regs[1]);
+				copies[item.regs[1]].insert(item.regs[0]);
+			}
+		}
+
+		// variables read before being written are live together at the entry
+		if (!live.in.empty())
+		{
+			for (const Value a : live.in[0])
+			{
+				for (const Value b : live.in[0])
+					edge(a, b);
+			}
+		}
+
+		std::vector<Value> order;
+		for (Value v = Config::max_nregs; v < p.names.size(); v++)
+			order.push_back(v);
+
+		std::stable_sort(order.begin(), order.end(), [&interferes] (const Value a, const Value b) { return interferes[a].size() > interferes[b].size(); });
+
+		std::vector<std::optional<Value>> color(p.names.size());
+		for (Value v = 0; v < Config::max_nregs; v++)
+			color[v] = v;
+
+		for (const Value v : order)
+		{
+			std::vector<bool> taken(nregs, false);
+
+			for (const Value n : interferes[v])
+			{
+				if (color[n] && *color[n] < nregs)
+					taken[*color[n]] = true;
+			}
+
+			for (const Value c : copies[v])
+			{
+				if (color[c] && *color[c] < nregs && !taken[*color[c]])
+				{
+					color[v] = color[c];
+					break;
+				}
+			}
+
+			for (Value r = 0; !color[v] && r < nregs; r++)
+			{
+				if (!taken[r])
+					color[v] = r;
+			}
+
+			if (!color[v])
+				throw Mylib::Exception(Mylib::build_str_from_stream("not enough registers for variable ", p.names[v]));
+		}
+
+		std::vector<Item> items;
+
+		for (Item &item : p.items)
+		{
+			if (item.kind == Item::Kind::Instr)
+			{
+				for (uint32_t field = 0; field < item.regs.size(); field++)
+				{
+					if (is_scalar_field(item.op, field))
+						item.regs[field] = *color[item.regs[field]];
+				}
+
+				std::vector<Value> used;
+				uses(item, used);
+
+				if (const auto d = def(item))
+					used.push_back(*d);
+
+				for (const Value r : used)
+				{
+					if (r >= nregs)
+						throw Mylib::Exception(Mylib::build_str_from_stream("line ", item.line, ": the machine has no register ", reg_name(r)));
+				}
+			}
+
+			if (item.kind == Item::Kind::Instr && item.op == Op::Copy)
+			{
+				const Value dest = item.regs[0];
+				const Value src = item.regs[1];
+
+				if (dest == src)
+					continue;
+
+				// dest = 0, dest = src + dest
+				items.push_back({.kind = Item::Kind::Instr, .op = Op::Mov, .regs = {dest, 0, 0}, .imm = 0, .line = item.line});
+				items.push_back({.kind = Item::Kind::Instr, .op = Op::Add, .regs = {dest, src, dest}, .line = item.line});
+				continue;
+			}
+
+			items.push_back(std::move(item));
+		}
+
+		p.items = std::move(items);
+	}
+
+	// ---------------------------------------
+
+	static std::string format(const Item &item, const std::string &target)
+	{
+		std::ostringstream out;
+
+		const auto name = [&item] (const uint32_t field) {
+			return is_scalar_field(item.op, field) ? reg_name(item.regs[field]) : vreg_name(item.regs[field]);
+		};
+
+		out << info(item.op).name;
+
+		if (is_alu(item.op) || is_vector_alu(item.op) || item.op == Op::Copy_block || item.op == Op::Fill_block || item.op == Op::Cmp_block)
+			out << " " << name(0) << ", " << name(1) << ", " << name(2);
+		else if (item.op == Op::Load || item.op == Op::Vload)
+			out << " " << name(0) << ", [" << name(1) << "]";
+		else if (item.op == Op::Store || item.op == Op::Vstore)
+			out << " [" << name(1) << "], " << name(2);
+		else if (item.op == Op::Vsplat || item.op == Op::Vsum)
+			out << " " << name(0) << ", " << name(1);
+		else if (item.op == Op::Jump)
+			out << " " << target;
+		else if (item.op == Op::Jump_cond || item.op == Op::Mov)
+			out << " " << reg_name(item.regs[0]) << ", " << target;
+
+		return out.str();
+	}
+
+	static uint16_t encode(const Item &item, const uint16_t imm)
+	{
+		const OpInfo &op = info(item.op);
+
+		if (op.r_type)
+			return (op.opcode << 9) | (item.regs[0] << 6) | (item.regs[1] << 3) | item.regs[2];
+
+		return 0x8000 | (op.opcode << 13) | (item.regs[0] << 10) | imm;
+	}
+
+	static uint32_t count_instructions(const Program &p)
+	{
+		return std::count_if(p.items.begin(), p.items.end(), [] (const Item &item) { return item.kind == Item::Kind::Instr; });
+	}
+
+	Result assemble(const std::string_view source, const uint32_t nregs, const bool optimize)
+	{
+		Program p;
+		Result result;
+
+		parse(p, source);
+
+		result.instructions_before = count_instructions(p);
+
+		if (optimize)
+			Asm::optimize(p);
+
+		allocate_registers(p, nregs);
+
+		result.instructions_after = count_instructions(p);
+
+		std::map<std::string, uint16_t, std::less<>> addresses;
+		uint32_t address = 1;
+
+		for (const Item &item : p.items)
+		{
+			if (item.kind == Item::Kind::Label)
+				addresses[item.symbol] = address;
+			else
+				address++;
+		}
+
+		mylib_assert_exception_msg(address <= Config::virtual_space_size, "program of ", address, " words does not fit in the address space")
+
+		std::ostringstream listing;
+
+		listing << "; " << result.instructions_after << " instructions, " << result.instructions_before << " before optimization\n";
+		listing << "0000  0000  ; unused, execution starts at 1\n";
+
+		result.image.push_back(0);
+
+		for (const Item &item : p.items)
+		{
+			if (item.kind == Item::Kind::Label)
+			{
+				listing << "            " << item.symbol << ":\n";
+				continue;
+			}
+
+			uint16_t word = item.imm;
+			std::string text;
+
+			if (item.kind == Item::Kind::Word)
+				text = ".word " + std::to_string(word);
+			else
+			{
+				uint16_t imm = item.imm;
+
+				if (!item.symbol.empty())
+				{
+					imm = addresses.at(item.symbol);
+
+					if (imm > max_immediate)
+						throw Mylib::Exception(Mylib::build_str_from_stream("line ", item.line, ": address ", imm, " of ", item.symbol, " does not fit in an immediate"));
+				}
+
+				word = encode(item, imm);
+				text = format(item, item.symbol.empty() ? std::to_string(imm) : item.symbol);
+			}
+
+			listing << std::hex << std::setfill('0') << std::setw(4) << result.image.size() << "  " << std::setw(4) << word << std::dec << std::setfill(' ')
+				<< "      " << std::left << std::setw(28) << text << std::right << "; line " << item.line << "\n";
+
+			result.image.push_back(word);
+		}
+
+		result.listing = listing.str();
+
+		return result;
+	}
+
+	// ---------------------------------------
+
+	// the instruction of word, nullopt if it does not encode one
+	static std::optional<Item> decode(const uint16_t word, uint16_t &imm)
+	{
+		Item item = {.kind = Item::Kind::Instr};
+
+		if (word & 0x8000)
+		{
+			const uint16_t opcode = (word >> 13) & 0x03;
+			const auto it = std::find_if(op_info.begin(), op_info.end(), [opcode] (const OpInfo &i) { return !i.r_type && i.opcode == opcode; });
+
+			if (it == op_info.end())
+				return std::nullopt;
+
+			item.op = static_cast<Op>(it - op_info.begin());
+			item.regs = {static_cast<Value>((word >> 10) & 0x07), 0, 0};
+			imm = word & max_immediate;
+		}
+		else
+		{
+			const uint16_t opcode = (word >> 9) & 0x3F;
+			const auto it = std::find_if(op_info.begin(), op_info.end(), [opcode] (const OpInfo &i) { return i.r_type && i.opcode == opcode; });
+
+			if (it == op_info.end())
+				return std::nullopt;
+
+			item.op = static_cast<Op>(it - op_info.begin());
+			item.regs = {static_cast<Value>((word >> 6) & 0x07), static_cast<Value>((word >> 3) & 0x07), static_cast<Value>(word & 0x07)};
+		}
+
+		return item;
+	}
+
+	std::string disassemble(const Lib::Executable &exe)
+	{
+		std::ostringstream out;
+
+		std::map<uint32_t, uint16_t> executable_words;
+
+		for (const Lib::Section &section : exe.sections)
+		{
+			for (uint32_t i = 0; section.executable() && i < section.data.size(); i++)
+				executable_words[section.vaddr + i] = section.data[i];
+		}
+
+		// words reached from the entry are code, jump targets get labels, the rest is data
+		std::set<uint32_t> code;
+		std::set<uint16_t> targets;
+		std::vector<uint32_t> stack = {exe.entry};
+
+		while (!stack.empty())
+		{
+			const uint32_t vaddr = stack.back();
+			stack.pop_back();
+
+			uint16_t imm = 0;
+			const auto it = executable_words.find(vaddr);
+			const auto item = (it == executable_words.end() || code.contains(vaddr)) ? std::nullopt : decode(it->second, imm);
+
+			if (!item)
+				continue;
+
+			code.insert(vaddr);
+
+			if (item->op == Op::Jump || item->op == Op::Jump_cond)
+			{
+				targets.insert(imm);
+				stack.push_back(imm);
+			}
+
+			if (item->op != Op::Jump)
+				stack.push_back(vaddr + 1);
+		}
+
+		const auto label = [] (const uint16_t vaddr) {
+			std::ostringstream s;
+			s << "L" << std::hex << std::setfill('0') << std::setw(4) << vaddr;
+			return s.str();
+		};
+
+		out << "; entry " << exe.entry << "\n";
+
+		for (const Lib::Section &section : exe.sections)
+		{
+			out << "; section at " << section.vaddr << ", " << section.size_words << " words, " << section.data.size() << " stored"
+				<< (section.writable() ? ", write" : "") << (section.executable() ? ", exec" : "") << "\n";
+
+			for (uint32_t i = 0; i < section.data.size(); i++)
+			{
+				const uint16_t vaddr = section.vaddr + i;
+				const uint16_t word = section.data[i];
+
+				std::ostringstream comment;
+				comment << "; " << std::hex << std::setfill('0') << std::setw(4) << vaddr << ": " << std::setw(4) << word;
+
+				if (word < 128 && std::isprint(word))
+					comment << " '" << static_cast<char>(word) << "'";
+
+				// raw images start with an unused word, the assembler adds it back
+				if (vaddr == 0 && exe.entry == 1)
+				{
+					out << "\t" << comment.str() << " unused\n";
+					continue;
+				}
+
+				if (targets.contains(vaddr) && code.contains(vaddr))
+					out << label(vaddr) << ":\n";
+
+				uint16_t imm = 0;
+				const auto item = code.contains(vaddr) ? decode(word, imm) : std::nullopt;
+				std::string text = ".word " + std::to_string(word);
+
+				if (item && (item->op == Op::Jump || item->op == Op::Jump_cond))
+				{
+					if (code.contains(imm))
+						text = format(*item, label(imm));
+				}
+				else if (item)
+					text = format(*item, std::to_string(imm));
+
+				out << "\t" << std::left << std::setw(28) << text << std::right << comment.str() << "\n";
+			}
+
+			if (section.size_words > section.data.size())
+				out << "\t; " << (section.size_words - section.data.size()) << " zero words\n";
+		}
+
+		return out.str();
+	}
+
+	// ---------------------------------------
+
+} // end namespace Asm
@@ -0,0 +1,58 @@
+#ifndef __ARQSIM_HEADER_ASM_H__
+#define __ARQSIM_HEADER_ASM_H__
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <cstdint>
+
+#include "lib.h"
+
+namespace Asm
+{
+
+	// ---------------------------------------
+
+	/*
+		One statement per line, ; starts a comment:
+			label:
+			add|sub|mul|div|cmp_equal|cmp_neq dest, op1, op2
+			load dest, [address]          store [address], value
+			copy_block dest, source, length
+			fill_block dest, value, length
+			cmp_block length, a, b        length becomes 1 if the blocks are equal, 0 otherwise
+			vload vd, [address]           vstore [address], vs
+			vadd|vsub|vmul|vcmp_equal vd, va, vb              vsplat vd, value    vsum dest, vs
+			mov dest, value               jump label          jump_cond reg, label (taken if reg is 1)
+			syscall
+			.word n, ...                  .string "text"      .const name n
+		Registers are r0 to r7 and vector registers v0 to v7, any other name in a register operand is a variable.
+		Source operands may also be numbers, characters ('a'), constants or labels, and mov
+		takes registers and any 16-bit value. These are expanded into a few instructions
+		using temporary variables.
+		Variables get the registers of the machine that are free while they are live,
+		syscall reads r0 to r3 and writes r1.
+		The image starts with an unused word, execution begins at address 1.
+	*/
+
+	struct Result
+	{
+		std::vector<uint16_t> image;
+		std::string listing; // address, encoding and source line of each word
+		uint32_t instructions_before; // after the expansion of the source
+		uint32_t instructions_after;
+	};
+
+	// optimize folds constants, threads jumps and removes unreachable code and unused results
+	// raises Mylib::Exception with the line of the error
+	Result assemble(const std::string_view source, const uint32_t nregs, const bool optimize);
+
+	// jump targets get labels, so code that takes no data addresses can be assembled again
+	std::string disassemble(const Lib::Executable &exe);
+
+	// ---------------------------------------
+
+} // end namespace Asm
+
+#endif
@@ -1,6 +1,9 @@
 #ifndef __ARQSIM_HEADER_CONFIG_H__
 #define __ARQSIM_HEADER_CONFIG_H__
 
+#include <array>
+#include <tuple>
+
 #include <cstdint>
 
 // #define CPU_DEBUG_MODE
@@ -8,15 +11,170 @@
 namespace Config
 {
 
-	inline constexpr uint32_t nregs = 8;
+	// registers addressable by the 3-bit register fields of the instructions
+	inline constexpr uint32_t max_nregs = 8;
+
+	// vector registers, the same on every machine: each lane is a word,
+	// so a vector is 128 bits and fits a single host SSE register
+	inline constexpr uint32_t vector_regs = 8;
+	inline constexpr uint32_t vector_lanes = 8;
+
+	// length of a virtual second, used by the sleep and runtime syscalls
+	inline constexpr uint32_t cycles_per_second = 4096;
+
+	// while halted, the keyboard is polled once every idle_poll_cycles simulated cycles
+	// waiting up to idle_poll_ms of host time when no sleeper is due before the next poll
+	inline constexpr uint32_t idle_poll_cycles = 1024;
+
+	inline constexpr int idle_poll_ms = 10;
+
+	// keyboard characters buffered for each process
+	inline constexpr uint32_t input_buffer_size = 64;
+
+	// inter-process communication
+	inline constexpr uint32_t max_pipes = 16;
+
+	inline constexpr uint32_t pipe_capacity_words = 256;
+
+	inline constexpr uint32_t max_message_queues = 16;
+
+	inline constexpr uint32_t mq_capacity = 8;
+
+	inline constexpr uint32_t mq_message_words = 64;
+
+	inline constexpr uint32_t max_shm_segments = 16;
+
+	inline constexpr uint32_t shm_max_pages = 16;
+
+	// asynchronous syscall rings, drained at every timer tick
+	inline constexpr uint32_t async_ring_max_entries = 64;
+
+	inline constexpr uint32_t async_ring_batch = 32; // submissions run per ring and tick
+
+	// kernel events kept for the trace shell command, the oldest ones are dropped
+	inline constexpr uint32_t trace_buffer_size = 4096;
+
+	inline constexpr uint32_t trace_show_events = 16;
+
+	// sampling profiler started by the profile shell command: default timer ticks between two samples,
+	// and samples kept until they are written to profile_file at shutdown
+	inline constexpr uint32_t profile_interval_ticks = 4;
+
+	inline constexpr uint32_t profile_buffer_size = 1 << 16;
+
+	inline constexpr const char *profile_file = "profile.folded";
+
+	// timer ticks between two refreshes of the top shell command
+	inline constexpr uint32_t top_refresh_ticks = 16;
+
+	// window layout used to size the text buffers of a headless terminal
+	inline constexpr uint32_t headless_columns = 120;
+
+	inline constexpr uint32_t headless_lines = 40;
+
+	// block device, the image is created zero filled if missing
+	inline constexpr const char *disk_image = "disk.img";
+
+	inline constexpr uint32_t disk_block_words = 256;
+
+	inline constexpr uint32_t disk_blocks = 1024;
 
-	inline constexpr uint16_t memsize_words = 1 << 15;
+	inline constexpr uint64_t disk_latency_cycles = 2048;
 
-	inline constexpr uint32_t timer_interrupt_cycles = 1024;
+	// flat file system: a directory in block 0, then a fixed extent of fs_file_blocks per file
+	inline constexpr uint32_t fs_max_files = 16;
+
+	inline constexpr uint32_t fs_file_blocks = 32;
+
+	inline constexpr uint32_t fs_name_words = 14; // including the terminating 0
+
+	inline constexpr uint32_t max_open_files = 8; // per process
+
+	static_assert(fs_max_files * (2 + fs_name_words) <= disk_block_words);
+	static_assert(1 + fs_max_files * fs_file_blocks <= disk_blocks);
+	static_assert(fs_file_blocks * disk_block_words <= 0xFFFF);
+
+	// write-back buffer cache in front of the disk
+	inline constexpr uint32_t cache_blocks = 16;
+
+	inline constexpr uint32_t cache_read_ahead_blocks = 2; // prefetched after a read miss
+
+	// process control blocks are allocated in slabs of process_slab_size
+	inline constexpr uint32_t max_processes = 1 << 12;
+
+	inline constexpr uint32_t process_slab_size = 64;
+
+	static_assert(max_processes % process_slab_size == 0);
+
+	enum class SchedulerPolicy
+	{
+		RoundRobin,
+		Mlfq
+	};
+
+	inline constexpr SchedulerPolicy scheduler_policy = SchedulerPolicy::RoundRobin;
+
+	// multi-level feedback queue, level 0 has the highest priority
+	inline constexpr uint32_t mlfq_levels = 3;
+
+	inline constexpr std::array<uint32_t, mlfq_levels> mlfq_quantum_ticks = {1, 2, 4};
+
+	inline constexpr uint32_t mlfq_boost_ticks = 64;
+
+	// admission control of the real-time class: sum of budget/period of all reservations
+	inline constexpr uint32_t edf_max_utilization_percent = 90;
 
 	inline constexpr uint32_t virtual_space_size = 1 << 16;
 
-	inline constexpr uint16_t page_size_words = 1 << 4;
+	// Large pages map 2^large_page_shift words of contiguous, aligned frames with a single entry.
+	// Binaries are mapped with large pages where they cover a whole large page.
+	inline constexpr bool large_pages = true;
+
+	inline constexpr uint32_t large_page_shift = 8;
+
+	inline constexpr uint32_t large_page_size_words = 1 << large_page_shift;
+
+	// fully associative translation cache, used to count page table walks
+	inline constexpr uint32_t tlb_entries = 8;
+
+	// freed frames zeroed per timer tick while the idle process runs, the rest are zeroed when allocated
+	inline constexpr uint32_t idle_zero_frames = 32;
+
+	static_assert(large_page_size_words <= virtual_space_size);
+
+	// Shape of a simulated machine. The cpu, memory, timer and page table walk are compiled
+	// once per machine, so these parameters are constants in their hot paths.
+	template <uint32_t nregs_, uint32_t memsize_words_, uint32_t timer_interrupt_cycles_, uint32_t page_shift_>
+	struct Machine
+	{
+		static inline constexpr uint32_t nregs = nregs_;
+		static inline constexpr uint32_t memsize_words = memsize_words_;
+		static inline constexpr uint32_t timer_interrupt_cycles = timer_interrupt_cycles_; // quantum
+		static inline constexpr uint32_t page_shift = page_shift_;
+		static inline constexpr uint32_t page_size_words = 1 << page_shift;
+
+		static_assert(nregs >= 4 && nregs <= max_nregs); // syscalls take their arguments in r0 to r3
+		static_assert(memsize_words <= (1 << 15)); // physical addresses are 16 bits
+		static_assert(page_shift < large_page_shift && memsize_words % large_page_size_words == 0);
+	};
+
+	struct DefaultMachine : Machine<8, 1 << 15, 1024, 4>
+	{
+		static inline constexpr const char *name = "default";
+	};
+
+	struct SmallMachine : Machine<4, 1 << 13, 512, 3>
+	{
+		static inline constexpr const char *name = "small";
+	};
+
+	struct BigPageMachine : Machine<8, 1 << 15, 2048, 6>
+	{
+		static inline constexpr const char *name = "bigpage";
+	};
+
+	// machines built into the simulator, chosen at startup with --machine, the first one is the default
+	using Machines = std::tuple<DefaultMachine, SmallMachine, BigPageMachine>;
 
 }
 
@@ -87,4 +87,48 @@ std::vector<uint16_t> load_from_disk_to_16bit_buffer (const std::string_view fna
 
 // ---------------------------------------
 
+Executable load_executable (const std::string_view fname)
+{
+	std::vector<uint16_t> file = load_from_disk_to_16bit_buffer(fname);
+
+	if (file.empty() || file[0] != executable_magic) {
+		const uint32_t size = file.size();
+		mylib_assert_exception_msg(size <= Config::virtual_space_size, "image ", fname, " does not fit in the address space")
+		return Executable { 1, { Section { 0, size, Section::Write | Section::Exec, std::move(file) } } };
+	}
+
+	static constexpr uint32_t header_words = 3;
+	static constexpr uint32_t section_header_words = 4;
+
+	mylib_assert_exception_msg(file.size() >= header_words, "truncated header in ", fname)
+
+	Executable exe;
+	exe.entry = file[1];
+
+	const uint32_t nsections = file[2];
+	uint32_t pos = header_words + nsections * section_header_words;
+
+	mylib_assert_exception_msg(pos <= file.size(), "truncated section headers in ", fname)
+
+	for (uint32_t i = 0; i < nsections; i++) {
+		const uint16_t *header = file.data() + header_words + i * section_header_words;
+		const uint32_t vaddr = header[0];
+		const uint32_t size_words = header[1];
+		const uint32_t file_words = header[2];
+
+		mylib_assert_exception_msg(file_words <= size_words, "section ", i, " of ", fname, " stores more words than its size")
+		mylib_assert_exception_msg(vaddr + size_words <= Config::virtual_space_size, "section ", i, " of ", fname, " is out of the address space")
+		mylib_assert_exception_msg(pos + file_words <= file.size(), "truncated section ", i, " in ", fname)
+
+		exe.sections.push_back(Section { static_cast<uint16_t>(vaddr), size_words, header[3], std::vector<uint16_t>(file.begin() + pos, file.begin() + pos + file_words) });
+		pos += file_words;
+	}
+
+	mylib_assert_exception_msg(pos == file.size(), "trailing data in ", fname)
+
+	return exe;
+}
+
+// ---------------------------------------
+
 } // end namespace
\ No newline at end of file
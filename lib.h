@@ -3,6 +3,8 @@
 
 #include <sstream>
 #include <vector>
+#include <array>
+#include <algorithm>
 
 #include <cstdint>
 
@@ -18,6 +20,180 @@ std::vector<uint16_t> load_from_disk_to_16bit_buffer (const std::string_view fna
 
 // ---------------------------------------
 
+/*
+	Executable format, in 16-bit words:
+		magic (executable_magic), entry point, number of sections
+		one header per section: virtual address, size in memory, words stored in the file, flags
+		the stored words of each section, in the order of the headers
+	The words of a section past the stored ones are zero (bss), they take no space in the file.
+	Files without the magic are raw images, loaded as one writable and executable section
+	at address 0 with the entry point at 1.
+*/
+
+inline constexpr uint16_t executable_magic = 0x7845;
+
+struct Section
+{
+	enum Flags : uint16_t
+	{
+		Write = 1 << 0,
+		Exec  = 1 << 1
+	};
+
+	uint16_t vaddr;
+	uint32_t size_words;
+	uint16_t flags;
+	std::vector<uint16_t> data; // the first data.size() words, the rest is zero
+
+	inline bool writable () const
+	{
+		return this->flags & Write;
+	}
+
+	inline bool executable () const
+	{
+		return this->flags & Exec;
+	}
+};
+
+struct Executable
+{
+	uint16_t entry;
+	std::vector<Section> sections;
+};
+
+// raises Mylib::Exception in case of error
+Executable load_executable (const std::string_view fname);
+
+// ---------------------------------------
+
+// fixed-capacity FIFO, never allocates
+template <typename T, uint32_t capacity>
+class RingBuffer
+{
+private:
+	std::array<T, capacity> data;
+	uint32_t head = 0;
+	uint32_t count = 0;
+
+public:
+	inline bool empty () const
+	{
+		return this->count == 0;
+	}
+
+	inline bool full () const
+	{
+		return this->count == capacity;
+	}
+
+	inline uint32_t size () const
+	{
+		return this->count;
+	}
+
+	inline uint32_t free_space () const
+	{
+		return capacity - this->count;
+	}
+
+	// i-th element from the front
+	inline T operator[] (const uint32_t i) const
+	{
+		return this->data[(this->head + i) % capacity];
+	}
+
+	inline T& front ()
+	{
+		return this->data[this->head];
+	}
+
+	// appends an element to be filled in place, the buffer must not be full
+	inline T& push_slot ()
+	{
+		T& slot = this->data[(this->head + this->count) % capacity];
+		this->count++;
+		return slot;
+	}
+
+	// returns false if full
+	bool push (const T& v)
+	{
+		if (this->full())
+			return false;
+
+		this->data[(this->head + this->count) % capacity] = v;
+		this->count++;
+
+		return true;
+	}
+
+	// drops the oldest element if full
+	void push_overwrite (const T& v)
+	{
+		if (this->full())
+			this->pop();
+
+		this->push(v);
+	}
+
+	T pop ()
+	{
+		const T v = this->data[this->head];
+
+		this->head = (this->head + 1) % capacity;
+		this->count--;
+
+		return v;
+	}
+
+	// bulk versions, copy at most two contiguous pieces
+	// return the number of elements copied
+
+	uint32_t push (const T *src, const uint32_t n)
+	{
+		const uint32_t total = std::min(n, this->free_space());
+		const uint32_t tail = (this->head + this->count) % capacity;
+		const uint32_t first = std::min(total, capacity - tail);
+
+		std::copy_n(src, first, this->data.begin() + tail);
+		std::copy_n(src + first, total - first, this->data.begin());
+		this->count += total;
+
+		return total;
+	}
+
+	// copies without removing
+	uint32_t peek (T *dest, const uint32_t n) const
+	{
+		const uint32_t total = std::min(n, this->count);
+		const uint32_t first = std::min(total, capacity - this->head);
+
+		std::copy_n(this->data.begin() + this->head, first, dest);
+		std::copy_n(this->data.begin(), total - first, dest + first);
+
+		return total;
+	}
+
+	// removes without copying
+	uint32_t drop (const uint32_t n)
+	{
+		const uint32_t total = std::min(n, this->count);
+
+		this->head = (this->head + total) % capacity;
+		this->count -= total;
+
+		return total;
+	}
+
+	uint32_t pop (T *dest, const uint32_t n)
+	{
+		return this->drop(this->peek(dest, n));
+	}
+};
+
+// ---------------------------------------
+
 }
 
 #endif
\ No newline at end of file
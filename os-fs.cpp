@@ -0,0 +1,78 @@
+#include <algorithm>
+
+#include "config.h"
+#include "os-fs.h"
+
+namespace OS
+{
+
+	// ---------------------------------------
+
+	BufferCache::BufferCache()
+	{
+		for (Buffer &buffer : this->buffers)
+		{
+			buffer.block = no_block;
+			this->lru.push_back(&buffer);
+		}
+	}
+
+	Buffer *BufferCache::find(const uint32_t block)
+	{
+		auto it = this->index.find(block);
+
+		return (it == this->index.end()) ? nullptr : *it->second;
+	}
+
+	void BufferCache::use(Buffer *buffer)
+	{
+		if (buffer->missed)
+			buffer->missed = false;
+		else
+		{
+			this->stats.hits++;
+
+			if (buffer->prefetched)
+				this->stats.read_ahead_hits++;
+		}
+
+		buffer->prefetched = false;
+
+		auto it = this->index.at(buffer->block);
+		this->lru.splice(this->lru.begin(), this->lru, it);
+	}
+
+	Buffer *BufferCache::victim()
+	{
+		for (auto it = this->lru.rbegin(); it != this->lru.rend(); ++it)
+		{
+			Buffer *buffer = *it;
+
+			if (!buffer->busy)
+				return buffer;
+		}
+
+		return nullptr;
+	}
+
+	void BufferCache::assign(Buffer *buffer, const uint32_t block)
+	{
+		mylib_assert_exception(!buffer->busy && !buffer->dirty)
+
+		auto it = std::find(this->lru.begin(), this->lru.end(), buffer);
+
+		if (buffer->block != no_block)
+			this->index.erase(buffer->block);
+
+		buffer->block = block;
+		buffer->valid = false;
+		buffer->prefetched = false;
+		buffer->missed = false;
+
+		this->lru.splice(this->lru.begin(), this->lru, it);
+		this->index[block] = this->lru.begin();
+	}
+
+	// ---------------------------------------
+
+} // end namespace
@@ -0,0 +1,101 @@
+#ifndef __ARQSIM_HEADER_OS_FS_H__
+#define __ARQSIM_HEADER_OS_FS_H__
+
+#include <array>
+#include <list>
+#include <unordered_map>
+
+#include <cstdint>
+
+#include <my-lib/macros.h>
+
+#include "config.h"
+#include "lib.h"
+
+namespace OS
+{
+
+	// ---------------------------------------
+
+	// directory entry, stored on disk as {used, size, name[fs_name_words]}
+	struct DirEntry
+	{
+		bool used = false;
+		uint16_t size = 0; // in words
+		std::array<uint16_t, Config::fs_name_words> name = {};
+	};
+
+	// entry of the per-process open file table
+	struct OpenFile
+	{
+		bool used = false;
+		uint16_t file;   // directory index
+		uint16_t offset; // in words
+	};
+
+	// ---------------------------------------
+
+	struct Buffer
+	{
+		uint32_t block;
+		bool valid = false;      // holds the block data
+		bool dirty = false;      // modified since it was read or written back
+		bool busy = false;       // a disk transfer is in flight
+		bool prefetched = false; // loaded by read-ahead and not used yet
+		bool missed = false;     // loaded on a miss, the next use is not a hit
+		std::array<uint16_t, Config::disk_block_words> data;
+	};
+
+	struct CacheStats
+	{
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t read_ahead = 0;      // blocks prefetched
+		uint64_t read_ahead_hits = 0; // prefetched blocks used afterwards
+		uint64_t write_backs = 0;
+	};
+
+	// Write-back buffer cache with LRU replacement.
+	// The cache only tracks buffers, disk transfers are started by the kernel.
+	class BufferCache
+	{
+	private:
+		std::array<Buffer, Config::cache_blocks> buffers;
+		std::list<Buffer *> lru; // most recently used first
+		std::unordered_map<uint32_t, std::list<Buffer *>::iterator> index;
+
+	public:
+		CacheStats stats;
+
+		static inline constexpr uint32_t no_block = ~uint32_t(0);
+
+		BufferCache();
+
+		// nullptr if the block is not cached
+		Buffer *find(const uint32_t block);
+
+		// marks the buffer as most recently used and updates the hit statistics
+		void use(Buffer *buffer);
+
+		// least recently used buffer without a transfer in flight, nullptr if none
+		Buffer *victim();
+
+		// rebinds a clean buffer returned by victim() to another block
+		void assign(Buffer *buffer, const uint32_t block);
+
+		inline std::array<Buffer, Config::cache_blocks> &get_buffers()
+		{
+			return this->buffers;
+		}
+
+		inline uint32_t size() const
+		{
+			return this->index.size();
+		}
+	};
+
+	// ---------------------------------------
+
+} // end namespace
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef __ARQSIM_HEADER_OS_IPC_H__
+#define __ARQSIM_HEADER_OS_IPC_H__
+
+#include <array>
+
+#include <cstdint>
+
+#include "config.h"
+#include "lib.h"
+#include "os-process.h"
+
+namespace OS
+{
+
+	// ---------------------------------------
+
+	// A closed pipe still delivers its buffered words, then reads return 0.
+	// The slot is reused once a closed pipe is drained, reading a free slot also returns 0.
+	struct Pipe
+	{
+		bool used = false;
+		bool closed = false;
+		Lib::RingBuffer<uint16_t, Config::pipe_capacity_words> buffer;
+		WaitQueue readers;
+		WaitQueue writers;
+
+		// statistics
+		uint64_t created_cycle;
+		uint64_t words;
+		uint32_t transfers;
+	};
+
+	// ---------------------------------------
+
+	struct Message
+	{
+		uint16_t len;
+		std::array<uint16_t, Config::mq_message_words> data;
+	};
+
+	// same lifetime rules as Pipe
+	struct MessageQueue
+	{
+		bool used = false;
+		bool closed = false;
+		Lib::RingBuffer<Message, Config::mq_capacity> messages;
+		WaitQueue senders;
+		WaitQueue receivers;
+
+		// statistics
+		uint64_t created_cycle;
+		uint64_t words;
+		uint32_t transfers;
+	};
+
+	// ---------------------------------------
+
+	// Frames of a segment are reference counted like any other frame:
+	// the segment holds one reference and every page table mapping it holds another.
+	// The segment is destroyed when its last user detaches or is killed.
+	struct SharedSegment
+	{
+		bool used = false;
+		uint16_t key;
+		uint32_t npages;
+		uint32_t users; // page tables the segment is attached to
+		std::array<uint32_t, Config::shm_max_pages> frames;
+	};
+
+	// ---------------------------------------
+
+} // end namespace
+
+#endif
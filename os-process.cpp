@@ -0,0 +1,36 @@
+#include "config.h"
+#include "os-process.h"
+
+namespace OS
+{
+
+	// ---------------------------------------
+
+	Process *ProcessPool::alloc()
+	{
+		if (this->free_list.empty())
+		{
+			if (this->slabs.size() * Config::process_slab_size >= Config::max_processes)
+				return nullptr;
+
+			Process *slab = new Process[Config::process_slab_size];
+			this->slabs.emplace_back(slab);
+
+			for (uint32_t i = 0; i < Config::process_slab_size; i++)
+				this->free_list.push_back(slab + i);
+		}
+
+		this->used++;
+
+		return this->free_list.pop_front();
+	}
+
+	void ProcessPool::free(Process *process)
+	{
+		this->used--;
+		this->free_list.push_back(process);
+	}
+
+	// ---------------------------------------
+
+} // end namespace
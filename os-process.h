@@ -0,0 +1,295 @@
+#ifndef __ARQSIM_HEADER_OS_PROCESS_H__
+#define __ARQSIM_HEADER_OS_PROCESS_H__
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <string>
+
+#include <cstdint>
+
+#include "config.h"
+#include "lib.h"
+#include "arq-sim.h"
+#include "os-fs.h"
+
+namespace OS
+{
+
+	// ---------------------------------------
+
+	struct Process;
+	class WaitQueue;
+
+	// Intrusive list hook. A process can be in one list per hook.
+	// Links are not copied along with the process.
+	struct ProcessLink
+	{
+		Process *prev = nullptr;
+		Process *next = nullptr;
+		const void *list = nullptr;
+
+		ProcessLink() = default;
+
+		ProcessLink(const ProcessLink &)
+		{
+		}
+
+		ProcessLink &operator=(const ProcessLink &)
+		{
+			return *this;
+		}
+	};
+
+	// ---------------------------------------
+
+	// asynchronous syscall ring registered by the process
+	struct AsyncRing
+	{
+		uint16_t vaddr = 0;
+		uint16_t entries = 0;      // 0 if no ring is registered
+		bool pending = false;      // submissions left after the last drain
+		bool sleeping = false;     // the first pending submission is a sleep
+		uint64_t wakeup_cycle = 0; // end of that sleep
+	};
+
+	// periodic real-time reservation, scheduled earliest deadline first
+	struct RealTime
+	{
+		uint32_t period_ticks = 0; // 0 for best effort processes
+		uint32_t budget_ticks = 0; // cpu time granted in each period
+		uint64_t period_cycles = 0; // period_ticks in cycles of the machine
+		uint64_t deadline_cycle = 0; // end of the current period, where the next one is released
+		uint32_t used_ticks = 0;   // budget used in the current period
+		bool job_done = false;     // the process waited for the next period
+		uint32_t deadline_misses = 0;
+	};
+
+	// resource accounting, shown by the top shell command
+	struct ProcessStats
+	{
+		uint64_t cpu_cycles = 0;
+		uint64_t instructions = 0;
+		uint64_t sleep_cycles = 0; // sleeping or blocked on a wait queue
+		uint32_t context_switches = 0;
+		uint32_t syscalls = 0;
+		uint32_t gpfs = 0;
+
+		// state when the process last got the cpu or went to sleep
+		uint64_t scheduled_cycle = 0;
+		uint64_t scheduled_instructions = 0;
+		uint64_t blocked_cycle = 0;
+
+		// cpu_cycles at the previous top refresh
+		uint64_t top_cpu_cycles = 0;
+	};
+
+	struct Process
+	{
+		uint16_t pid;
+		std::string name;
+		uint16_t pc;
+		std::array<uint16_t, Config::max_nregs> registers;
+		std::array<Arch::Vector, Config::vector_regs> vregs;
+		enum class State
+		{
+			Running,
+			Ready,
+			Blocked
+		};
+		State state;
+		Arch::PageTable page_table;
+		uint64_t start_cycle;
+		uint64_t wakeup_cycle;
+
+		// scheduling
+		uint8_t nice = 0;
+		uint8_t priority = 0;       // current mlfq level, 0 is the highest
+		uint32_t quantum_ticks = 0; // timer ticks used at the current level
+
+		// keyboard input, filled while the process is in the foreground
+		Lib::RingBuffer<uint16_t, Config::input_buffer_size> input;
+
+		WaitQueue *wait_queue = nullptr; // set while blocked on a wait queue
+
+		AsyncRing ring;
+
+		ProcessStats stats;
+
+		RealTime rt;
+
+		std::array<OpenFile, Config::max_open_files> files;
+
+		ProcessLink queue_link; // ready queue or wait queue
+		ProcessLink table_link; // list of all processes
+		ProcessLink name_link;  // processes sharing the same name
+		ProcessLink ring_link;  // processes with an async ring
+		ProcessLink rt_link;    // admitted real-time processes
+		uint32_t sleep_index;   // position in the sleep queue
+	};
+
+	// ---------------------------------------
+
+	// Doubly linked list threaded through a ProcessLink member of Process.
+	// All operations are O(1) and never allocate.
+	template <ProcessLink Process::*link>
+	class ProcessList
+	{
+	private:
+		Process *head = nullptr;
+		Process *tail = nullptr;
+		uint32_t count = 0;
+
+	public:
+		class Iterator
+		{
+		private:
+			Process *process;
+
+		public:
+			Iterator(Process *process)
+				: process(process)
+			{
+			}
+
+			inline Process *operator*() const
+			{
+				return this->process;
+			}
+
+			inline Iterator &operator++()
+			{
+				this->process = (this->process->*link).next;
+				return *this;
+			}
+
+			inline bool operator!=(const Iterator &other) const
+			{
+				return this->process != other.process;
+			}
+		};
+
+		ProcessList() = default;
+		ProcessList(const ProcessList &) = delete;
+		ProcessList &operator=(const ProcessList &) = delete;
+
+		inline Iterator begin() const
+		{
+			return Iterator(this->head);
+		}
+
+		inline Iterator end() const
+		{
+			return Iterator(nullptr);
+		}
+
+		inline bool empty() const
+		{
+			return this->count == 0;
+		}
+
+		inline uint32_t size() const
+		{
+			return this->count;
+		}
+
+		inline Process *front() const
+		{
+			return this->head;
+		}
+
+		inline bool contains(const Process *process) const
+		{
+			return (process->*link).list == this;
+		}
+
+		void push_back(Process *process)
+		{
+			ProcessLink &node = process->*link;
+
+			mylib_assert_exception(node.list == nullptr)
+
+			node.list = this;
+			node.prev = this->tail;
+			node.next = nullptr;
+
+			if (this->tail != nullptr)
+				(this->tail->*link).next = process;
+			else
+				this->head = process;
+
+			this->tail = process;
+			this->count++;
+		}
+
+		// returns false if the process is not in this list
+		bool remove(Process *process)
+		{
+			ProcessLink &node = process->*link;
+
+			if (node.list != this)
+				return false;
+
+			if (node.prev != nullptr)
+				(node.prev->*link).next = node.next;
+			else
+				this->head = node.next;
+
+			if (node.next != nullptr)
+				(node.next->*link).prev = node.prev;
+			else
+				this->tail = node.prev;
+
+			node.prev = nullptr;
+			node.next = nullptr;
+			node.list = nullptr;
+			this->count--;
+
+			return true;
+		}
+
+		Process *pop_front()
+		{
+			Process *process = this->head;
+
+			if (process != nullptr)
+				this->remove(process);
+
+			return process;
+		}
+	};
+
+	using ProcessQueue = ProcessList<&Process::queue_link>;
+
+	// processes blocked until some kernel event
+	class WaitQueue : public ProcessQueue
+	{
+	};
+
+	// ---------------------------------------
+
+	// Slab allocator for process control blocks.
+	// Freed processes keep their buffers (page table, name), so reusing them does not allocate.
+	class ProcessPool
+	{
+	private:
+		std::vector<std::unique_ptr<Process[]>> slabs;
+		ProcessQueue free_list;
+		uint32_t used = 0;
+
+	public:
+		// returns nullptr when Config::max_processes are in use
+		Process *alloc();
+		void free(Process *process);
+
+		inline uint32_t get_used() const
+		{
+			return this->used;
+		}
+	};
+
+	// ---------------------------------------
+
+} // end namespace
+
+#endif
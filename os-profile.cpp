@@ -0,0 +1,142 @@
+#include <map>
+#include <tuple>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+
+#include "config.h"
+#include "os-profile.h"
+
+namespace OS
+{
+
+	// ---------------------------------------
+
+	static std::string syscall_str(const uint16_t syscall)
+	{
+		static constexpr auto strs = std::to_array<const char *>({"exit", "print", "newline", "print_number", nullptr, nullptr, "sleep", "runtime",
+																  "fork", "nice", "read_char", "read_line", "pipe_create", "pipe_write", "pipe_read", "pipe_close",
+																  "mq_create", "mq_send", "mq_receive", "mq_close", "shm_get", "shm_attach", "shm_detach", "write",
+																  "ring_setup", "ring_submit", "rt_reserve", "rt_wait", "open", "read", "write_file", "close"});
+
+		if (syscall < strs.size() && strs[syscall] != nullptr)
+			return strs[syscall];
+
+		return "syscall " + std::to_string(syscall);
+	}
+
+	// label and source line of each address, read from an assembler listing
+	struct Symbols
+	{
+		std::map<uint16_t, std::string> labels; // first address after each label
+		std::map<uint16_t, uint32_t> lines;
+	};
+
+	static Symbols load_listing(const std::filesystem::path &fname)
+	{
+		Symbols symbols;
+		std::ifstream in(fname);
+		std::string line;
+		std::string label;
+
+		while (std::getline(in, line))
+		{
+			// label lines are indented, the other ones start with the address in hex
+			if (line.empty() || line[0] == ';')
+				continue;
+
+			if (line[0] == ' ')
+			{
+				const size_t begin = line.find_first_not_of(' ');
+
+				if (begin != std::string::npos && line.back() == ':')
+					label = line.substr(begin, line.size() - begin - 1);
+				continue;
+			}
+
+			uint16_t address;
+
+			if (!(std::istringstream(line.substr(0, 4)) >> std::hex >> address))
+				continue;
+
+			if (!label.empty())
+			{
+				symbols.labels[address] = label;
+				label.clear();
+			}
+
+			if (const size_t pos = line.rfind("; line "); pos != std::string::npos)
+				symbols.lines[address] = std::stoul(line.substr(pos + 7));
+		}
+
+		return symbols;
+	}
+
+	static std::string frames(const Symbols *symbols, const uint16_t pc)
+	{
+		if (symbols == nullptr || !symbols->lines.contains(pc))
+		{
+			std::ostringstream address;
+			address << "0x" << std::hex << std::setfill('0') << std::setw(4) << pc;
+			return address.str();
+		}
+
+		std::string str;
+
+		if (auto it = symbols->labels.upper_bound(pc); it != symbols->labels.begin())
+			str = std::prev(it)->second + ";";
+
+		return str + "line " + std::to_string(symbols->lines.at(pc));
+	}
+
+	void Profiler::write_folded(std::ostream &out, const NameFunction &name) const
+	{
+		// distinct samples first, so each program is named and symbolized once
+		std::map<std::tuple<uint16_t, uint16_t, uint16_t>, uint64_t> weights;
+
+		for (uint32_t i = 0; i < this->count; i++)
+			weights[{this->samples[i].pid, this->samples[i].pc, this->samples[i].syscall}] += this->samples[i].weight;
+
+		std::map<uint16_t, std::string> programs;
+		std::map<std::string, Symbols> listings;
+		std::map<std::string, uint64_t> stacks;
+
+		for (const auto &[key, weight] : weights)
+		{
+			const auto [pid, pc, syscall] = key;
+
+			if (!programs.contains(pid))
+			{
+				const auto exited = this->exited_names.find(pid);
+				programs[pid] = (exited == this->exited_names.end()) ? name(pid) : exited->second;
+			}
+
+			const std::string &program = programs[pid];
+
+			// programs are run from bin/, the assembler writes the listing next to the binary
+			if (!listings.contains(program))
+			{
+				const std::filesystem::path listing = std::filesystem::path("bin") / std::filesystem::path(program).replace_extension(".lst");
+
+				if (std::filesystem::exists(listing))
+					listings[program] = load_listing(listing);
+			}
+
+			const auto it = listings.find(program);
+			const Symbols *symbols = (it == listings.end()) ? nullptr : &it->second;
+
+			// a blocked process stopped after its syscall instruction
+			if (syscall == no_syscall)
+				stacks[program + ";" + frames(symbols, pc)] += weight;
+			else
+				stacks[program + ";" + frames(symbols, pc - 1) + ";[" + syscall_str(syscall) + "]"] += weight;
+		}
+
+		for (const auto &[stack, weight] : stacks)
+			out << stack << " " << weight << "\n";
+	}
+
+	// ---------------------------------------
+
+} // end namespace
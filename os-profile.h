@@ -0,0 +1,81 @@
+#ifndef __ARQSIM_HEADER_OS_PROFILE_H__
+#define __ARQSIM_HEADER_OS_PROFILE_H__
+
+#include <array>
+#include <map>
+#include <string>
+#include <ostream>
+#include <functional>
+
+#include <cstdint>
+
+#include "config.h"
+
+namespace OS
+{
+
+	// ---------------------------------------
+
+	struct ProfileSample
+	{
+		uint16_t pid;
+		uint16_t pc;
+		uint16_t syscall; // service the process is blocked in, Profiler::no_syscall while it runs
+		uint16_t weight;  // sampling periods since the previous sample
+	};
+
+	// Samples taken at timer interrupts are stored in a fixed buffer and only symbolized when written.
+	// Once the buffer is full, new samples are counted and dropped.
+	class Profiler
+	{
+	public:
+		using NameFunction = std::function<std::string (const uint16_t pid)>;
+
+		static inline constexpr uint16_t no_syscall = 0xFFFF;
+
+	private:
+		std::array<ProfileSample, Config::profile_buffer_size> samples;
+		uint32_t count = 0;
+		uint64_t dropped = 0;
+
+		// programs of the processes that exited after sampling started
+		std::map<uint16_t, std::string> exited_names;
+
+	public:
+		inline void record(const uint16_t pid, const uint16_t pc, const uint16_t syscall, const uint16_t weight)
+		{
+			if (this->count < this->samples.size())
+				this->samples[this->count++] = {pid, pc, syscall, weight};
+			else
+				this->dropped++;
+		}
+
+		// called when a process exits, its samples are named after it once its pid is gone
+		inline void process_exited(const uint16_t pid, const std::string &name)
+		{
+			if (this->count > 0)
+				this->exited_names[pid] = name;
+		}
+
+		inline uint32_t size() const
+		{
+			return this->count;
+		}
+
+		inline uint64_t get_dropped() const
+		{
+			return this->dropped;
+		}
+
+		// Folded stacks for flamegraph.pl, one line per stack with its weight:
+		//   program;label;line N[;syscall name] weight
+		// name gives the program of a pid that did not exit, labels and source lines come from its listing
+		// in bin/ when the assembler wrote one, otherwise the frame is the address.
+		void write_folded(std::ostream &out, const NameFunction &name) const;
+	};
+
+	// ---------------------------------------
+
+} // end namespace
+
+#endif
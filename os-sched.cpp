@@ -0,0 +1,348 @@
+#include <algorithm>
+
+#include "config.h"
+#include "os-sched.h"
+
+namespace OS
+{
+
+	// ---------------------------------------
+
+	const char *RoundRobinScheduler::get_name() const
+	{
+		return "rr";
+	}
+
+	void RoundRobinScheduler::enqueue(Process *process)
+	{
+		this->queue.push_back(process);
+	}
+
+	void RoundRobinScheduler::remove(Process *process)
+	{
+		this->queue.remove(process);
+	}
+
+	Process *RoundRobinScheduler::pick_next()
+	{
+		return this->queue.pop_front();
+	}
+
+	bool RoundRobinScheduler::tick(Process *current)
+	{
+		return !this->queue.empty();
+	}
+
+	uint32_t RoundRobinScheduler::size() const
+	{
+		return this->queue.size();
+	}
+
+	// ---------------------------------------
+
+	const char *MlfqScheduler::get_name() const
+	{
+		return "mlfq";
+	}
+
+	void MlfqScheduler::enqueue(Process *process)
+	{
+		// a process may never sit above the level granted by its nice value
+		if (process->priority < process->nice)
+		{
+			process->priority = process->nice;
+			process->quantum_ticks = 0;
+		}
+
+		this->queues[process->priority].push_back(process);
+	}
+
+	void MlfqScheduler::remove(Process *process)
+	{
+		this->queues[process->priority].remove(process);
+	}
+
+	Process *MlfqScheduler::pick_next()
+	{
+		for (auto &queue : this->queues)
+		{
+			if (!queue.empty())
+				return queue.pop_front();
+		}
+
+		return nullptr;
+	}
+
+	bool MlfqScheduler::tick(Process *current)
+	{
+		if (++this->ticks_since_boost >= Config::mlfq_boost_ticks)
+			this->boost(current);
+
+		current->quantum_ticks++;
+
+		if (current->quantum_ticks >= Config::mlfq_quantum_ticks[current->priority])
+		{
+			if (current->priority + 1u < Config::mlfq_levels)
+				current->priority++;
+
+			current->quantum_ticks = 0;
+
+			return this->size() > 0;
+		}
+
+		return this->has_ready_above(current->priority);
+	}
+
+	uint32_t MlfqScheduler::size() const
+	{
+		uint32_t count = 0;
+
+		for (const auto &queue : this->queues)
+			count += queue.size();
+
+		return count;
+	}
+
+	void MlfqScheduler::boost(Process *current)
+	{
+		this->ticks_since_boost = 0;
+
+		current->priority = current->nice;
+		current->quantum_ticks = 0;
+
+		for (uint32_t level = 1; level < Config::mlfq_levels; level++)
+		{
+			auto &queue = this->queues[level];
+
+			for (Process *process = queue.front(); process != nullptr;)
+			{
+				Process *next = process->queue_link.next;
+
+				process->quantum_ticks = 0;
+
+				if (process->nice < level)
+				{
+					queue.remove(process);
+					process->priority = process->nice;
+					this->queues[process->priority].push_back(process);
+				}
+
+				process = next;
+			}
+		}
+	}
+
+	bool MlfqScheduler::has_ready_above(const uint8_t priority) const
+	{
+		return std::any_of(this->queues.begin(), this->queues.begin() + priority,
+			[] (const auto &queue) { return !queue.empty(); });
+	}
+
+	// ---------------------------------------
+
+	const char *EdfScheduler::get_name() const
+	{
+		return "edf";
+	}
+
+	uint32_t EdfScheduler::utilization_of(const uint32_t period_ticks, const uint32_t budget_ticks)
+	{
+		// rounded up, so admission never overcommits
+		return (budget_ticks * 1000 + period_ticks - 1) / period_ticks;
+	}
+
+	bool EdfScheduler::admit(Process *process, const uint32_t period_ticks, const uint32_t budget_ticks, const uint32_t tick_cycles, const uint64_t now)
+	{
+		if (period_ticks == 0 || budget_ticks == 0 || budget_ticks > period_ticks)
+			return false;
+
+		RealTime &rt = process->rt;
+		const uint32_t current = this->is_member(process) ? utilization_of(rt.period_ticks, rt.budget_ticks) : 0;
+		const uint32_t requested = utilization_of(period_ticks, budget_ticks);
+
+		if (this->utilization - current + requested > Config::edf_max_utilization_percent * 10)
+			return false;
+
+		this->utilization = this->utilization - current + requested;
+
+		rt.period_ticks = period_ticks;
+		rt.budget_ticks = budget_ticks;
+		rt.period_cycles = uint64_t(period_ticks) * tick_cycles;
+		rt.deadline_cycle = now + rt.period_cycles;
+		rt.used_ticks = 0;
+		rt.job_done = false;
+
+		if (!this->is_member(process))
+			this->members.push_back(process);
+
+		return true;
+	}
+
+	void EdfScheduler::leave(Process *process)
+	{
+		if (!this->members.remove(process))
+			return;
+
+		this->utilization -= utilization_of(process->rt.period_ticks, process->rt.budget_ticks);
+		process->rt.period_ticks = 0;
+		process->rt.budget_ticks = 0;
+	}
+
+	void EdfScheduler::enqueue(Process *process)
+	{
+		this->ready.push_back(process);
+	}
+
+	void EdfScheduler::remove(Process *process)
+	{
+		this->ready.remove(process);
+	}
+
+	Process *EdfScheduler::pick_next()
+	{
+		Process *next = nullptr;
+
+		for (Process *process : this->ready)
+		{
+			if (next == nullptr || process->rt.deadline_cycle < next->rt.deadline_cycle)
+				next = process;
+		}
+
+		if (next != nullptr)
+			this->ready.remove(next);
+
+		return next;
+	}
+
+	void EdfScheduler::release(const uint64_t now)
+	{
+		for (Process *process : this->members)
+		{
+			RealTime &rt = process->rt;
+
+			while (rt.deadline_cycle <= now)
+			{
+				if (!rt.job_done)
+					rt.deadline_misses++;
+
+				rt.deadline_cycle += rt.period_cycles;
+				rt.used_ticks = 0;
+				rt.job_done = false;
+			}
+		}
+	}
+
+	bool EdfScheduler::charge(Process *current)
+	{
+		return ++current->rt.used_ticks >= current->rt.budget_ticks;
+	}
+
+	bool EdfScheduler::has_earlier_deadline(const uint64_t deadline_cycle) const
+	{
+		for (const Process *process : this->ready)
+		{
+			if (process->rt.deadline_cycle < deadline_cycle)
+				return true;
+		}
+
+		return false;
+	}
+
+	uint64_t EdfScheduler::next_release() const
+	{
+		uint64_t cycle = UINT64_MAX;
+
+		for (const Process *process : this->members)
+			cycle = std::min(cycle, process->rt.deadline_cycle);
+
+		return cycle;
+	}
+
+	// ---------------------------------------
+
+	SleepQueue::SleepQueue()
+	{
+		this->heap.reserve(Config::max_processes);
+	}
+
+	void SleepQueue::push(Process *process)
+	{
+		this->heap.push_back(process);
+		process->sleep_index = this->heap.size() - 1;
+		this->sift_up(process->sleep_index);
+	}
+
+	Process *SleepQueue::pop()
+	{
+		Process *process = this->heap.front();
+		this->remove(process);
+		return process;
+	}
+
+	void SleepQueue::remove(Process *process)
+	{
+		const uint32_t i = process->sleep_index;
+		Process *last = this->heap.back();
+
+		this->heap.pop_back();
+
+		if (last == process)
+			return;
+
+		this->place(i, last);
+		this->sift_up(i);
+		this->sift_down(last->sleep_index);
+	}
+
+	void SleepQueue::place(const uint32_t i, Process *process)
+	{
+		this->heap[i] = process;
+		process->sleep_index = i;
+	}
+
+	void SleepQueue::sift_up(uint32_t i)
+	{
+		Process *process = this->heap[i];
+
+		while (i > 0)
+		{
+			const uint32_t parent = (i - 1) / 2;
+
+			if (this->heap[parent]->wakeup_cycle <= process->wakeup_cycle)
+				break;
+
+			this->place(i, this->heap[parent]);
+			i = parent;
+		}
+
+		this->place(i, process);
+	}
+
+	void SleepQueue::sift_down(uint32_t i)
+	{
+		Process *process = this->heap[i];
+		const uint32_t n = this->heap.size();
+
+		while (true)
+		{
+			uint32_t child = 2 * i + 1;
+
+			if (child >= n)
+				break;
+
+			if (child + 1 < n && this->heap[child + 1]->wakeup_cycle < this->heap[child]->wakeup_cycle)
+				child++;
+
+			if (process->wakeup_cycle <= this->heap[child]->wakeup_cycle)
+				break;
+
+			this->place(i, this->heap[child]);
+			i = child;
+		}
+
+		this->place(i, process);
+	}
+
+	// ---------------------------------------
+
+} // end namespace
@@ -0,0 +1,190 @@
+#ifndef __ARQSIM_HEADER_OS_SCHED_H__
+#define __ARQSIM_HEADER_OS_SCHED_H__
+
+#include <array>
+#include <vector>
+
+#include <cstdint>
+
+#include "config.h"
+#include "os-process.h"
+
+namespace OS
+{
+
+	// ---------------------------------------
+
+	// A scheduler only holds ready processes.
+	// The running process is taken out with pick_next() and handed back with enqueue() when preempted.
+	class Scheduler
+	{
+	public:
+		virtual ~Scheduler() = default;
+
+		virtual const char *get_name() const = 0;
+
+		virtual void enqueue(Process *process) = 0;
+
+		// removes a ready process that is being killed
+		virtual void remove(Process *process) = 0;
+
+		// returns nullptr if there is no ready process
+		virtual Process *pick_next() = 0;
+
+		// called on every timer interrupt for the running process
+		// returns true if it must be preempted
+		virtual bool tick(Process *current) = 0;
+
+		virtual uint32_t size() const = 0;
+
+		inline bool empty() const
+		{
+			return this->size() == 0;
+		}
+	};
+
+	// ---------------------------------------
+
+	// every process runs for one timer interval in turn, nice is ignored
+	class RoundRobinScheduler : public Scheduler
+	{
+	private:
+		ProcessQueue queue;
+
+	public:
+		const char *get_name() const override;
+		void enqueue(Process *process) override;
+		void remove(Process *process) override;
+		Process *pick_next() override;
+		bool tick(Process *current) override;
+		uint32_t size() const override;
+	};
+
+	// ---------------------------------------
+
+	// Multi-level feedback queue.
+	// A process that uses its whole quantum is demoted one level; every Config::mlfq_boost_ticks
+	// all processes go back to the level given by their nice value.
+	class MlfqScheduler : public Scheduler
+	{
+	private:
+		std::array<ProcessQueue, Config::mlfq_levels> queues;
+		uint32_t ticks_since_boost = 0;
+
+	public:
+		const char *get_name() const override;
+		void enqueue(Process *process) override;
+		void remove(Process *process) override;
+		Process *pick_next() override;
+		bool tick(Process *current) override;
+		uint32_t size() const override;
+
+	private:
+		void boost(Process *current);
+		bool has_ready_above(const uint8_t priority) const;
+	};
+
+	// ---------------------------------------
+
+	// Real-time class, always served before the best-effort scheduler.
+	// Each admitted process reserves budget_ticks of cpu in every period of period_ticks.
+	// Ready processes run earliest deadline first. A process that used its budget,
+	// or finished its job early, waits on throttled until its next period is released.
+	class EdfScheduler
+	{
+	private:
+		ProcessQueue ready;
+		ProcessList<&Process::rt_link> members;
+		uint32_t utilization = 0; // sum of budget/period, in 1/1000
+
+	public:
+		WaitQueue throttled;
+
+		const char *get_name() const;
+
+		// admission control, the first period starts at now, tick_cycles is the length of a timer tick
+		// returns false if the reservation does not fit
+		bool admit(Process *process, const uint32_t period_ticks, const uint32_t budget_ticks, const uint32_t tick_cycles, const uint64_t now);
+
+		// back to best effort, the process must not be in the ready queue
+		void leave(Process *process);
+
+		void enqueue(Process *process);
+		void remove(Process *process);
+
+		// returns nullptr if there is no ready process
+		Process *pick_next();
+
+		// starts the periods that are due, counting the jobs that missed their deadline
+		void release(const uint64_t now);
+
+		// charges one timer tick to the running process
+		// returns true if its budget is exhausted
+		bool charge(Process *current);
+
+		bool has_earlier_deadline(const uint64_t deadline_cycle) const;
+
+		// cycle of the next period release, UINT64_MAX if there is no member
+		uint64_t next_release() const;
+
+		inline bool is_member(const Process *process) const
+		{
+			return this->members.contains(process);
+		}
+
+		inline uint32_t size() const
+		{
+			return this->ready.size();
+		}
+
+		inline bool empty() const
+		{
+			return this->ready.empty();
+		}
+
+	private:
+		static uint32_t utilization_of(const uint32_t period_ticks, const uint32_t budget_ticks);
+	};
+
+	// ---------------------------------------
+
+	// Binary min-heap of sleeping processes ordered by wakeup_cycle.
+	// Each process records its position, so it can be removed in O(log n) when killed.
+	class SleepQueue
+	{
+	private:
+		std::vector<Process *> heap;
+
+	public:
+		SleepQueue();
+
+		inline bool empty() const
+		{
+			return this->heap.empty();
+		}
+
+		inline uint32_t size() const
+		{
+			return this->heap.size();
+		}
+
+		inline Process *front() const
+		{
+			return this->heap.front();
+		}
+
+		void push(Process *process);
+		Process *pop();
+		void remove(Process *process);
+
+	private:
+		void place(const uint32_t i, Process *process);
+		void sift_up(uint32_t i);
+		void sift_down(uint32_t i);
+	};
+
+	// ---------------------------------------
+
+} // end namespace
+
+#endif
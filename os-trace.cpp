@@ -0,0 +1,109 @@
+#include <set>
+
+#include "config.h"
+#include "os-trace.h"
+
+namespace OS
+{
+
+	// ---------------------------------------
+
+	static const char *event_str(const TraceEvent event)
+	{
+		switch (event)
+		{
+		case TraceEvent::Create:
+			return "create";
+		case TraceEvent::Schedule:
+			return "schedule";
+		case TraceEvent::Unschedule:
+			return "unschedule";
+		case TraceEvent::Sleep:
+			return "sleep";
+		case TraceEvent::Wakeup:
+			return "wakeup";
+		case TraceEvent::Block:
+			return "block";
+		case TraceEvent::Unblock:
+			return "unblock";
+		case TraceEvent::Fork:
+			return "fork";
+		case TraceEvent::Nice:
+			return "nice";
+		case TraceEvent::Kill:
+			return "kill";
+		}
+
+		return "unknown";
+	}
+
+	static bool has_arg(const TraceEvent event)
+	{
+		return (event == TraceEvent::Sleep) || (event == TraceEvent::Fork) || (event == TraceEvent::Nice);
+	}
+
+	static std::string json_escape(const std::string &str)
+	{
+		std::string escaped;
+
+		for (const char c : str)
+		{
+			if (c == '"' || c == '\\')
+				escaped += '\\';
+			escaped += c;
+		}
+
+		return escaped;
+	}
+
+	std::string TraceBuffer::format(const uint32_t i, const NameFunction &name) const
+	{
+		const TraceRecord record = this->records[i];
+		std::string str = std::to_string(record.cycle) + " " + event_str(record.event) + " " + name(record.pid);
+
+		if (has_arg(record.event))
+			str += " " + std::to_string(record.arg);
+
+		return str;
+	}
+
+	void TraceBuffer::write_chrome_json(std::ostream &out, const NameFunction &name) const
+	{
+		std::set<uint16_t> pids;
+
+		out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+
+		for (uint32_t i = 0; i < this->records.size(); i++)
+		{
+			const TraceRecord record = this->records[i];
+
+			pids.insert(record.pid);
+
+			out << "{\"pid\": 0, \"tid\": " << record.pid << ", \"ts\": " << record.cycle << ", ";
+
+			// the time a process holds the cpu is drawn as a slice
+			if (record.event == TraceEvent::Schedule)
+				out << "\"ph\": \"B\", \"name\": \"running\"";
+			else if (record.event == TraceEvent::Unschedule)
+				out << "\"ph\": \"E\", \"name\": \"running\"";
+			else
+			{
+				out << "\"ph\": \"i\", \"s\": \"t\", \"name\": \"" << event_str(record.event) << "\"";
+
+				if (has_arg(record.event))
+					out << ", \"args\": {\"arg\": " << record.arg << "}";
+			}
+
+			out << "},\n";
+		}
+
+		for (const uint16_t pid : pids)
+			out << "{\"pid\": 0, \"tid\": " << pid << ", \"ph\": \"M\", \"name\": \"thread_name\", \"args\": {\"name\": \"" << json_escape(name(pid)) << "\"}},\n";
+
+		out << "{\"pid\": 0, \"ph\": \"M\", \"name\": \"process_name\", \"args\": {\"name\": \"kernel\"}}\n";
+		out << "]}\n";
+	}
+
+	// ---------------------------------------
+
+} // end namespace
@@ -0,0 +1,75 @@
+#ifndef __ARQSIM_HEADER_OS_TRACE_H__
+#define __ARQSIM_HEADER_OS_TRACE_H__
+
+#include <string>
+#include <ostream>
+#include <functional>
+
+#include <cstdint>
+
+#include "config.h"
+#include "lib.h"
+
+namespace OS
+{
+
+	// ---------------------------------------
+
+	enum class TraceEvent : uint8_t
+	{
+		Create,
+		Schedule,
+		Unschedule,
+		Sleep,   // arg: seconds
+		Wakeup,
+		Block,
+		Unblock,
+		Fork,    // arg: child pid
+		Nice,    // arg: nice value
+		Kill
+	};
+
+	struct TraceRecord
+	{
+		uint64_t cycle;
+		TraceEvent event;
+		uint16_t pid;
+		uint16_t arg;
+	};
+
+	// Kernel events are stored in binary form and only formatted when the trace is read.
+	class TraceBuffer
+	{
+	public:
+		using NameFunction = std::function<std::string (const uint16_t pid)>;
+
+	private:
+		Lib::RingBuffer<TraceRecord, Config::trace_buffer_size> records;
+
+	public:
+		inline void record(const uint64_t cycle, const TraceEvent event, const uint16_t pid, const uint16_t arg = 0)
+		{
+			this->records.push_overwrite({cycle, event, pid, arg});
+		}
+
+		inline uint32_t size() const
+		{
+			return this->records.size();
+		}
+
+		inline void clear()
+		{
+			this->records = {};
+		}
+
+		std::string format(const uint32_t i, const NameFunction &name) const;
+
+		// Chrome trace event format, one thread per pid, cycles are written as microseconds
+		void write_chrome_json(std::ostream &out, const NameFunction &name) const;
+	};
+
+	// ---------------------------------------
+
+} // end namespace
+
+#endif
@@ -0,0 +1,114 @@
+#include <set>
+#include <vector>
+#include <optional>
+#include <utility>
+#include <tuple>
+
+#include "config.h"
+#include "arq-sim.h"
+#include "os-verify.h"
+
+namespace OS
+{
+
+	// ---------------------------------------
+
+	std::string verify_executable(const Lib::Executable &exe, const uint32_t nregs)
+	{
+		// the bss of an executable section reads as 0
+		const auto word_at = [&exe] (const uint32_t vaddr) -> std::optional<uint16_t> {
+			for (const Lib::Section &section : exe.sections)
+			{
+				if (section.executable() && vaddr >= section.vaddr && vaddr < section.vaddr + section.size_words)
+					return (vaddr - section.vaddr < section.data.size()) ? section.data[vaddr - section.vaddr] : 0;
+			}
+
+			return std::nullopt;
+		};
+
+		// r0 is tracked along each path to tell exit apart from the syscalls that return,
+		// registers start at 0
+		static constexpr int32_t unknown = -1;
+
+		// after a syscall with an unknown r0 the path may never run: the words there are data
+		// if the program exits, invalid ones only keep their page unverified (see map_section)
+		std::set<std::tuple<uint32_t, int32_t, bool>> visited;
+		std::vector<std::tuple<uint32_t, int32_t, bool>> stack = {{exe.entry, 0, true}};
+
+		while (!stack.empty())
+		{
+			auto [vaddr, r0, certain] = stack.back();
+			stack.pop_back();
+
+			if (!visited.insert({vaddr, r0, certain}).second)
+				continue;
+
+			const std::optional<uint16_t> word = word_at(vaddr);
+
+			// leaving the code raises a GPF at run time, it cannot bring the simulator down
+			if (!word)
+				continue;
+
+			if (!Arch::valid_instruction(*word, nregs))
+			{
+				if (certain)
+					return "invalid instruction " + std::to_string(*word) + " at " + std::to_string(vaddr);
+				continue;
+			}
+
+			if (*word & 0x8000)
+			{
+				const Arch::OpcodeI opcode = static_cast<Arch::OpcodeI>((*word >> 13) & 0x03);
+				const uint16_t reg = (*word >> 10) & 0x07;
+				const uint16_t imm = *word & 0x1FF;
+
+				if (opcode == Arch::OpcodeI::Jump || opcode == Arch::OpcodeI::Jump_cond)
+					stack.push_back({imm, r0, certain});
+
+				if (opcode == Arch::OpcodeI::Jump)
+					continue;
+
+				if (opcode == Arch::OpcodeI::Mov && reg == 0)
+					r0 = imm;
+			}
+			else
+			{
+				const Arch::OpcodeR opcode = static_cast<Arch::OpcodeR>((*word >> 9) & 0x3F);
+				const uint16_t dest = (*word >> 6) & 0x07;
+
+				if (opcode == Arch::OpcodeR::Syscall)
+				{
+					if (r0 == 0)
+						continue;
+
+					if (r0 == unknown)
+						certain = false;
+				}
+				else if (opcode != Arch::OpcodeR::Store && opcode != Arch::OpcodeR::Copy_block && opcode != Arch::OpcodeR::Fill_block && opcode != Arch::OpcodeR::Vstore
+					&& (Arch::scalar_fields(opcode) & 0b100) && dest == 0)
+					r0 = unknown;
+			}
+
+			stack.push_back({vaddr + 1, r0, certain});
+		}
+
+		return std::string();
+	}
+
+	std::string load_verified_executable(const std::string_view fname, const uint32_t nregs, Lib::Executable &exe)
+	{
+		try
+		{
+			exe = Lib::load_executable(fname);
+		}
+		catch (const Mylib::Exception &e)
+		{
+			return e.what();
+		}
+
+		return verify_executable(exe, nregs);
+	}
+
+	// ---------------------------------------
+
+} // end namespace
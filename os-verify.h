@@ -0,0 +1,32 @@
+#ifndef __ARQSIM_HEADER_OS_VERIFY_H__
+#define __ARQSIM_HEADER_OS_VERIFY_H__
+
+#include <string>
+#include <string_view>
+
+#include <cstdint>
+
+#include "config.h"
+#include "lib.h"
+
+namespace OS
+{
+
+	// ---------------------------------------
+
+	// Follows the control flow from the entry point of an executable, through the executable
+	// sections, until each path loops, exits (r0 known to be 0 at a syscall) or leaves the code.
+	// Every word reached must be a valid instruction for a machine of nregs registers,
+	// except after a syscall with an unknown r0, which may be an exit followed by data.
+	// Returns an empty string if the code is fine, the reason otherwise.
+	std::string verify_executable(const Lib::Executable &exe, const uint32_t nregs);
+
+	// Loads and verifies the executable in fname, so malformed images and invalid code
+	// are rejected the same way. Returns an empty string on success, the reason otherwise.
+	std::string load_verified_executable(const std::string_view fname, const uint32_t nregs, Lib::Executable &exe);
+
+	// ---------------------------------------
+
+} // end namespace
+
+#endif
@@ -3,67 +3,211 @@
 #include <string_view>
 #include <array>
 #include <list>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <iterator>
 
 #include <cstdint>
 #include <cstdlib>
 #include <filesystem>
-#include <time.h>
+#include <fstream>
+#include <sstream>
+#include <ostream>
 
 #include "config.h"
 #include "lib.h"
 #include "arq-sim.h"
 #include "os.h"
+#include "os-process.h"
+#include "os-sched.h"
+#include "os-ipc.h"
+#include "os-trace.h"
+#include "os-fs.h"
+#include "os-verify.h"
+#include "os-profile.h"
 
 namespace OS
 {
 
 	using Arch::PageTable;
 
-	struct MemoryInterval
-	{
-		uint16_t start;
-		uint16_t end;
-	};
-
-	struct Process
-	{
-		uint16_t pid;
-		std::string name;
-		uint16_t pc;
-		std::array<uint16_t, Config::nregs> registers;
-		enum class State
-		{
-			Running,
-			Ready,
-			Blocked
-		};
-		State state;
-		PageTable page_table;
-		time_t start_application_time;
-		time_t application_wakeup_time;
-	};
-
 	struct Frame
 	{
 		Process *process;
 		bool free;
+		uint16_t refs; // number of page tables mapping this frame
 	};
 
 	Arch::Terminal *terminal;
 	Arch::Cpu *cpu;
+	Arch::Disk *disk;
+
+	// parameters of the machine the kernel runs on, set at boot
+	const Arch::MachineInfo *machine;
 
 	std::string typedCharacters;
 
 	Process *current_process_ptr = nullptr;
 	Process *idle_process_ptr = nullptr;
 
-	std::list<Process *> ready_processes;
-	std::list<Process *>::iterator ready_processes_begin = ready_processes.begin();
-	std::list<Process *> blocked_processes;
+	Scheduler *scheduler = nullptr;
+
+	EdfScheduler rt_scheduler;
+
+	// every process except idle
+	ProcessList<&Process::table_link> processes;
+
+	ProcessPool process_pool;
+
+	// indexed by pid
+	std::vector<Process *> process_table(1 << 16, nullptr);
+
+	// buckets are kept when they get empty, so names seen before cost no allocation
+	std::unordered_map<std::string, ProcessList<&Process::name_link>> processes_by_name;
+
+	SleepQueue sleeping_processes;
+
+	// keyboard input goes to the shell while there is no foreground process
+	Process *foreground_process = nullptr;
+
+	WaitQueue input_waiters;
+
+	std::array<Pipe, Config::max_pipes> pipes;
+
+	std::array<MessageQueue, Config::max_message_queues> message_queues;
+
+	std::array<SharedSegment, Config::max_shm_segments> shared_segments;
+
+	ProcessList<&Process::ring_link> ring_processes;
+
+	TraceBuffer trace_buffer;
+
+	BufferCache buffer_cache;
+
+	// disk transfers issued by the buffer cache, the front one is in flight
+	struct DiskRequest
+	{
+		Buffer *buffer;
+		bool write;
+	};
+
+	std::list<DiskRequest> disk_requests;
+
+	// processes waiting for a buffer to be loaded or written back
+	WaitQueue disk_waiters;
+
+	std::array<DirEntry, Config::fs_max_files> directory;
+	bool directory_dirty = false;
+
+	// top shell command
+	bool top_live = false;
+	uint32_t top_ticks = 0;
+	uint64_t top_cycle = 0;
+
+	// sampling profiler, stopped while profile_period is 0
+	Profiler profiler;
+	uint64_t profile_period = 0; // in cycles
+	uint64_t profile_cycle = 0;  // accounted by the previous sample
+
+	// startup script, stepped from the timer interrupt
+	struct Script
+	{
+		std::vector<std::string> lines;
+		uint32_t next = 0;
+		bool loaded = false;
+		bool active = false;
+		bool wait_all = false;     // waiting for every process to exit
+		uint64_t wakeup_cycle = 0; // end of a sleep command
+	};
+
+	Script script;
+
+	// processes that exited while a script is loaded, for the final summary
+	struct ExitRecord
+	{
+		uint16_t pid;
+		std::string name;
+		uint64_t start_cycle;
+		uint64_t end_cycle;
+		ProcessStats stats;
+	};
+
+	std::vector<ExitRecord> exited_processes;
+
+	// returned in r1 by failed syscalls
+	inline constexpr uint16_t syscall_error = 0xFFFF;
+
+	// sized at boot for the memory of the machine
+	std::vector<Frame> free_frames;
+
+	// Frames freed since they were last zeroed. They are zeroed in bulk when allocated again,
+	// or a few at a time while the cpu is idle, so freeing a process costs no memory writes.
+	std::vector<bool> frame_needs_zero;
+	uint32_t frames_needing_zero = 0;
+	uint32_t zero_cursor = 0; // where the idle zeroing resumes
+
+	// Always zero, shared copy-on-write by the bss pages of every process.
+	// The kernel holds a reference so it is never freed.
+	uint32_t zero_page_frame;
+
+	// executable pages loaded, and the ones holding only valid instructions
+	uint64_t code_pages = 0;
+	uint64_t verified_pages = 0;
+
+	uint64_t frames_zeroed_on_alloc = 0;
+	uint64_t frames_zeroed_idle = 0;
+
+	inline constexpr uint32_t no_frame = ~uint32_t(0);
+
+	// words of every binary loaded and of the pages mapped for them, to measure internal fragmentation
+	uint64_t image_words_loaded = 0;
+	uint64_t image_words_mapped = 0;
+
+	uint16_t next_pid = 0;
+
+	// returns a pid that no live process is using
+	uint16_t alloc_pid(Process *process)
+	{
+		while (process_table[next_pid] != nullptr)
+			next_pid++;
+
+		process_table[next_pid] = process;
+
+		return next_pid++;
+	}
+
+	Process *find_process(const uint16_t pid)
+	{
+		return process_table[pid];
+	}
+
+	void register_process(Process *process)
+	{
+		processes.push_back(process);
+		processes_by_name[process->name].push_back(process);
+	}
+
+	void unregister_process(Process *process)
+	{
+		processes.remove(process);
+		processes_by_name[process->name].remove(process);
+		process_table[process->pid] = nullptr;
+	}
+
+	const char *state_str(const Process::State state)
+	{
+		static constexpr auto strs = std::to_array<const char *>({"Running",
+																  "Ready",
+																  "Blocked"});
 
-	std::list<MemoryInterval> free_memory_intervals = {{0, Config::memsize_words - 1}};
+		return strs[std::to_underlying(state)];
+	}
 
-	std::vector<Frame> free_frames(Config::memsize_words >> 4, {nullptr, true});
+	bool is_number(const std::string_view str)
+	{
+		return !str.empty() && std::all_of(str.begin(), str.end(), [] (const char c) { return c >= '0' && c <= '9'; });
+	}
 
 	void panic(const std::string_view msg)
 	{
@@ -71,17 +215,32 @@ namespace OS
 		cpu->turn_off();
 	}
 
+	inline void trace(const TraceEvent event, const Process *process, const uint16_t arg = 0)
+	{
+		trace_buffer.record(cpu->get_cycle(), event, process->pid, arg);
+	}
+
 	void init_page_table(PageTable &page_table)
 	{
-		const uint32_t num_pages = Config::virtual_space_size >> 4;
+		const uint32_t num_pages = Config::virtual_space_size / machine->page_size_words;
 		page_table.frames.resize(num_pages);
 		for (uint32_t i = 0; i < num_pages; ++i)
 		{
 			page_table.frames[i] = {i, false};
 		}
+
+		page_table.large_frames.assign(Config::virtual_space_size / Config::large_page_size_words, {0, false});
+	}
+
+	void zero_frame(const uint32_t frame_number)
+	{
+		std::fill_n(cpu->pmem_span(frame_number * machine->page_size_words, machine->page_size_words), machine->page_size_words, 0);
+		frame_needs_zero[frame_number] = false;
+		frames_needing_zero--;
 	}
 
-	uint32_t allocate_frame(Process *process)
+	// takes a free frame for the process, zeroed unless the caller overwrites all of it
+	uint32_t allocate_frame(Process *process, const bool zero = true)
 	{
 		for (uint32_t i = 0; i < free_frames.size(); ++i)
 		{
@@ -89,114 +248,303 @@ namespace OS
 			{
 				free_frames[i].free = false;
 				free_frames[i].process = process;
+				free_frames[i].refs = 1;
+
+				if (frame_needs_zero[i])
+				{
+					if (zero)
+					{
+						zero_frame(i);
+						frames_zeroed_on_alloc++;
+					}
+					else
+					{
+						frame_needs_zero[i] = false;
+						frames_needing_zero--;
+					}
+				}
+
 				return i;
 			}
 		}
-		return 0;
+		return no_frame;
 	}
 
-	void desallocate_frame(Process *process)
+	// zeroes up to max_frames free frames that still hold old data
+	void zero_idle_frames(const uint32_t max_frames)
+	{
+		for (uint32_t n = 0, scanned = 0; n < max_frames && frames_needing_zero > 0 && scanned < free_frames.size(); scanned++)
+		{
+			if (frame_needs_zero[zero_cursor] && free_frames[zero_cursor].free)
+			{
+				zero_frame(zero_cursor);
+				frames_zeroed_idle++;
+				n++;
+			}
+
+			zero_cursor = (zero_cursor + 1) % free_frames.size();
+		}
+	}
+
+	inline uint32_t frames_per_large_page()
+	{
+		return Config::large_page_size_words / machine->page_size_words;
+	}
+
+	// returns the first of frames_per_large_page() contiguous frames, aligned to their count
+	uint32_t allocate_large_frame(Process *process)
 	{
-		for (auto &frame : free_frames)
+		for (uint32_t first = 0; first < free_frames.size(); first += frames_per_large_page())
 		{
-			if (frame.process == process)
+			const auto begin = free_frames.begin() + first;
+
+			if (std::all_of(begin, begin + frames_per_large_page(), [] (const Frame &frame) { return frame.free; }))
 			{
-				frame.free = true;
-				frame.process = nullptr;
+				std::fill_n(begin, frames_per_large_page(), Frame{process, false, 1});
+
+				for (uint32_t i = first; i < first + frames_per_large_page(); i++)
+				{
+					if (frame_needs_zero[i])
+					{
+						zero_frame(i);
+						frames_zeroed_on_alloc++;
+					}
+				}
+
+				return first;
 			}
 		}
+		return no_frame;
+	}
+
+	void release_frame(const uint32_t frame_number)
+	{
+		Frame &frame = free_frames[frame_number];
+
+		if (--frame.refs == 0)
+		{
+			frame.free = true;
+			frame.process = nullptr;
+			frame_needs_zero[frame_number] = true;
+			frames_needing_zero++;
+		}
 	}
 
-	std::list<MemoryInterval>::iterator find_free_memory_interval(const uint16_t size)
+	SharedSegment *find_segment(const uint32_t frame_number)
 	{
-		for (auto it = free_memory_intervals.begin(); it != free_memory_intervals.end(); ++it)
+		for (auto &segment : shared_segments)
 		{
-			if (it->end - it->start + 1 >= size)
-				return it;
+			if (segment.used && std::find(segment.frames.begin(), segment.frames.begin() + segment.npages, frame_number) != segment.frames.begin() + segment.npages)
+				return &segment;
 		}
-		return free_memory_intervals.end();
+		return nullptr;
+	}
+
+	void destroy_segment(SharedSegment &segment)
+	{
+		for (uint32_t i = 0; i < segment.npages; i++)
+			release_frame(segment.frames[i]);
+
+		segment.used = false;
 	}
 
-	MemoryInterval allocate_memory(const uint16_t size)
+	// a segment is mapped as a whole, so its users are counted on its first frame
+	void share_frame(const uint32_t frame_number)
 	{
-		auto iterator = find_free_memory_interval(size);
-		if (iterator == free_memory_intervals.end())
-			return {1, 0};
+		free_frames[frame_number].refs++;
 
-		MemoryInterval *interval = &(*iterator);
+		SharedSegment *segment = find_segment(frame_number);
 
-		MemoryInterval new_memory = {interval->start, uint16_t(interval->start + size - 1)};
+		if (segment != nullptr && segment->frames[0] == frame_number)
+			segment->users++;
+	}
 
-		if (interval->end - interval->start + 1 == size)
-			free_memory_intervals.erase(iterator);
-		else
-			interval->start += size;
+	void release_shared_frame(const uint32_t frame_number)
+	{
+		SharedSegment *segment = find_segment(frame_number);
+
+		release_frame(frame_number);
 
-		return new_memory;
+		if (segment != nullptr && segment->frames[0] == frame_number && --segment->users == 0)
+			destroy_segment(*segment);
 	}
 
-	void desallocate_memory(const MemoryInterval &memory)
+	void desallocate_frame(Process *process)
 	{
-		for (uint32_t i = memory.start; i <= memory.end; ++i)
+		for (auto &entry : process->page_table.frames)
 		{
-			cpu->pmem_write(i, 0);
+			if (entry.valid)
+			{
+				if (entry.shared)
+					release_shared_frame(entry.frame_number);
+				else
+					release_frame(entry.frame_number);
+				entry.valid = false;
+			}
 		}
 
-		free_memory_intervals.push_back(memory);
+		for (auto &entry : process->page_table.large_frames)
+			entry.valid = false;
 	}
 
-	Process *create_process(const std::string_view fname)
+	// Stored words get their own frames, whole large pages of them contiguous frames when available.
+	// The rest of the section maps the zero page copy-on-write, so bss takes frames only once written.
+	bool map_section(Process *process, const Lib::Section &section)
 	{
-		const uint32_t size = Lib::get_file_size_words(fname);
-		if (size <= Config::memsize_words)
-		{
-			std::vector<uint16_t> bin = Lib::load_from_disk_to_16bit_buffer(fname);
+		const uint32_t page_size = machine->page_size_words;
+		std::vector<Arch::PageTableBase> &frames = process->page_table.frames;
 
-			Process *process = new Process();
+		if (section.vaddr % page_size != 0)
+		{
+			terminal->println(Arch::Terminal::Type::Kernel, "Section at " + std::to_string(section.vaddr) + " is not page aligned\n");
+			return false;
+		}
 
-			MemoryInterval memory = allocate_memory(bin.size());
+		const uint32_t first_page = section.vaddr / page_size;
+		const uint32_t end_page = first_page + (section.size_words + page_size - 1) / page_size;
+		const uint32_t stored_pages = (section.data.size() + page_size - 1) / page_size;
 
-			if (memory.start == 1 && memory.end == 0)
+		for (uint32_t i = first_page; i < end_page; i++)
+		{
+			if (frames[i].valid)
 			{
-				terminal->println(Arch::Terminal::Type::Kernel, "Not enough memory to create process\n");
-				return nullptr;
+				terminal->println(Arch::Terminal::Type::Kernel, "Section at " + std::to_string(section.vaddr) + " overlaps another section\n");
+				return false;
 			}
+		}
+
+		const auto entry = [&section] (const uint32_t frame_number) {
+			return Arch::PageTableBase{.frame_number = frame_number, .valid = true, .writable = section.writable(), .executable = section.executable()};
+		};
 
-			process->pc = 1;
+		uint32_t page = first_page;
 
-			for (uint32_t i = 0; i < Config::nregs; i++)
-				process->registers[i] = 0;
+		// whole large pages of stored words, as long as contiguous frames are found
+		if constexpr (Config::large_pages)
+		{
+			while (page % frames_per_large_page() == 0 && (page - first_page + frames_per_large_page()) * page_size <= section.data.size())
+			{
+				const uint32_t frame_number = allocate_large_frame(process);
 
-			process->state = Process::State::Ready;
-			process->start_application_time = time(NULL);
+				if (frame_number == no_frame)
+					break;
 
-			init_page_table(process->page_table);
+				process->page_table.large_frames[page / frames_per_large_page()] = {frame_number, true};
 
-			const uint32_t num_pages = (bin.size() + Config::page_size_words - 1) >> 4;
-			for (uint32_t i = 0; i < num_pages; ++i)
-			{
-				process->page_table.frames[i] = {allocate_frame(process), true};
+				for (uint32_t j = 0; j < frames_per_large_page(); j++)
+					frames[page++] = entry(frame_number + j);
 			}
+		}
 
-			for (uint32_t i = 0; i < bin.size(); i++)
+		for (; page < first_page + stored_pages; page++)
+		{
+			const uint32_t frame_number = allocate_frame(process);
+
+			if (frame_number == no_frame)
 			{
-				uint32_t vaddr = i;
-				uint32_t paddr = cpu->translate(&process->page_table, vaddr);
-				cpu->pmem_write(paddr, bin[i]);
+				terminal->println(Arch::Terminal::Type::Kernel, "Not enough frames to create process\n");
+				return false;
 			}
 
-			process->name = fname.substr(4);
+			frames[page] = entry(frame_number);
+		}
+
+		for (; page < end_page; page++)
+		{
+			frames[page] = entry(zero_page_frame);
+			frames[page].writable = false;
+			frames[page].cow = section.writable();
+			free_frames[zero_page_frame].refs++;
+		}
+
+		// pages of valid instructions run without the cpu checks, the first store to one clears verified
+		for (uint32_t i = first_page; section.executable() && i < end_page; i++)
+		{
+			const uint32_t begin = (i - first_page) * page_size;
+			bool verified = true;
+
+			for (uint32_t j = begin; verified && j < begin + page_size; j++)
+				verified = Arch::valid_instruction(j < section.data.size() ? section.data[j] : 0, machine->nregs);
+
+			frames[i].verified = verified;
+			frames[i].write_trap = verified && section.writable();
+			frames[i].writable = frames[i].writable && !frames[i].write_trap;
+
+			code_pages++;
+			verified_pages += verified;
+		}
+
+		for (uint32_t i = 0; i < section.data.size(); i += page_size)
+		{
+			const uint32_t n = std::min<uint32_t>(page_size, section.data.size() - i);
+			std::copy_n(section.data.begin() + i, n, cpu->pmem_span(frames[first_page + i / page_size].frame_number * page_size, n));
+		}
+
+		image_words_loaded += section.data.size();
+		image_words_mapped += stored_pages * page_size;
+
+		return true;
+	}
+
+	Process *create_process(const std::string_view fname)
+	{
+		Lib::Executable exe;
+
+		if (const std::string error = load_verified_executable(fname, machine->nregs, exe); !error.empty())
+		{
+			terminal->println(Arch::Terminal::Type::Kernel, "Rejected " + std::string(fname) + ": " + error + "\n");
+			return nullptr;
+		}
+
+		Process *process = process_pool.alloc();
+
+		if (process == nullptr)
+		{
+			terminal->println(Arch::Terminal::Type::Kernel, "Too many processes\n");
+			return nullptr;
+		}
+
+		process->pid = alloc_pid(process);
+		process->pc = exe.entry;
+		process->nice = 0;
+		process->priority = 0;
+		process->quantum_ticks = 0;
+		process->ring = AsyncRing();
+		process->stats = ProcessStats();
+		process->rt = RealTime();
+		process->files = {};
+		process->input = {};
+
+		for (uint32_t i = 0; i < machine->nregs; i++)
+			process->registers[i] = 0;
+
+		for (Arch::Vector &v : process->vregs)
+			v.fill(0);
+
+		process->state = Process::State::Ready;
+		process->start_cycle = cpu->get_cycle();
 
-			terminal->println(Arch::Terminal::Type::Kernel, "Process " + process->name + " created\n");
+		init_page_table(process->page_table);
 
-			if (process->name != "idle.bin")
+		for (const Lib::Section &section : exe.sections)
+		{
+			if (!map_section(process, section))
 			{
-				ready_processes.push_back(process);
-				ready_processes_begin = ready_processes.begin();
+				desallocate_frame(process);
+				process_table[process->pid] = nullptr;
+				process_pool.free(process);
+				return nullptr;
 			}
-			return process;
 		}
-		return nullptr;
+
+		process->name = fname.substr(4);
+
+		trace(TraceEvent::Create, process);
+
+		if (process->name != "idle.bin")
+			register_process(process);
+
+		return process;
 	}
 
 	void schedule_process(Process *process)
@@ -207,16 +555,21 @@ namespace OS
 		if (process->state != Process::State::Ready)
 			panic("Process not ready");
 
-		terminal->println(Arch::Terminal::Type::Kernel, "Running process: " + process->name + "\n");
+		trace(TraceEvent::Schedule, process);
 
 		process->state = Process::State::Running;
+		process->stats.scheduled_cycle = cpu->get_cycle();
+		process->stats.scheduled_instructions = cpu->get_executed_instructions();
 		current_process_ptr = process;
 
 		cpu->set_pc(process->pc);
 		cpu->set_page_table(&process->page_table);
 
-		for (uint32_t i = 0; i < Config::nregs; i++)
+		for (uint32_t i = 0; i < machine->nregs; i++)
 			cpu->set_gpr(i, process->registers[i]);
+
+		for (uint32_t i = 0; i < Config::vector_regs; i++)
+			cpu->set_vreg(i, process->vregs[i]);
 	}
 
 	void unschedule_process()
@@ -230,128 +583,1867 @@ namespace OS
 			panic("Process not running");
 
 		process->state = Process::State::Ready;
-		for (uint32_t i = 0; i < Config::nregs; i++)
+		for (uint32_t i = 0; i < machine->nregs; i++)
 			process->registers[i] = cpu->get_gpr(i);
 
+		for (uint32_t i = 0; i < Config::vector_regs; i++)
+			process->vregs[i] = cpu->get_vreg(i);
+
 		process->pc = cpu->get_pc();
 
+		process->stats.cpu_cycles += cpu->get_cycle() - process->stats.scheduled_cycle;
+		process->stats.instructions += cpu->get_executed_instructions() - process->stats.scheduled_instructions;
+		process->stats.context_switches++;
+
+		// submissions queued while running are picked up by the next tick, even if the cpu halts
+		if (process->ring.entries != 0)
+			process->ring.pending = true;
+
 		current_process_ptr = nullptr;
 
-		terminal->println(Arch::Terminal::Type::Kernel, "Unschedule process: " + process->name + "\n");
+		trace(TraceEvent::Unschedule, process);
 	}
 
-	Process *search_process(const std::string_view fname)
+	// real-time processes go to the edf class, the others to the best-effort scheduler
+	void enqueue_ready(Process *process)
 	{
-		for (auto it = ready_processes.begin(); it != ready_processes.end(); it++)
-		{
-			Process *process = *it;
-			if (process->name == fname)
-				return process;
-		}
-		for (auto it = blocked_processes.begin(); it != blocked_processes.end(); it++)
+		if (rt_scheduler.is_member(process))
+			rt_scheduler.enqueue(process);
+		else
+			scheduler->enqueue(process);
+	}
+
+	void remove_ready(Process *process)
+	{
+		if (rt_scheduler.is_member(process))
+			rt_scheduler.remove(process);
+		else
+			scheduler->remove(process);
+	}
+
+	// puts the next ready process, or idle, on the free cpu
+	void dispatch()
+	{
+		Process *process = rt_scheduler.pick_next();
+
+		if (process == nullptr)
+			process = scheduler->pick_next();
+
+		schedule_process(process != nullptr ? process : idle_process_ptr);
+	}
+
+	// takes the running process off the cpu and hands it back to the scheduler
+	void preempt()
+	{
+		Process *process = current_process_ptr;
+
+		unschedule_process();
+
+		if (process != idle_process_ptr)
+			enqueue_ready(process);
+	}
+
+	void set_scheduler(Scheduler *new_scheduler)
+	{
+		if (scheduler != nullptr)
 		{
-			Process *process = *it;
-			if (process->name == fname)
-				return process;
+			while (Process *process = scheduler->pick_next())
+				new_scheduler->enqueue(process);
+
+			delete scheduler;
 		}
-		return nullptr;
+
+		scheduler = new_scheduler;
 	}
 
-	void round_robin()
+	// arg is either a pid or a process name
+	// prints the reason and returns nullptr if it does not name exactly one process
+	Process *lookup_process(const std::string &arg)
 	{
-		if (current_process_ptr != idle_process_ptr && ready_processes.size() > 1)
+		if (is_number(arg))
 		{
-			if ((*ready_processes_begin)->state == Process::State::Ready)
-			{
-				Process *process = *ready_processes_begin;
-				ready_processes.push_back(process);
-				ready_processes.pop_front();
-				ready_processes_begin = ready_processes.begin();
+			Process *process = (arg.size() <= 5 && std::stoul(arg) < process_table.size()) ? find_process(std::stoul(arg)) : nullptr;
 
-				unschedule_process();
-				schedule_process(process);
+			if (process == nullptr || process == idle_process_ptr)
+			{
+				terminal->println(Arch::Terminal::Type::Command, "No process with pid " + arg + "\n");
+				return nullptr;
 			}
+
+			return process;
 		}
-	}
-	void list_processes()
-	{
-		terminal->println(Arch::Terminal::Type::Command, "Processes:\n");
-		for (auto it = ready_processes.begin(); it != ready_processes.end(); it++)
+
+		const auto it = processes_by_name.find(arg);
+
+		if (it == processes_by_name.end() || it->second.empty())
 		{
-			Process *process = *it;
-			terminal->println(Arch::Terminal::Type::Command, process->name + "\n");
+			terminal->println(Arch::Terminal::Type::Command, "No process named " + arg + "\n");
+			return nullptr;
 		}
-	}
 
-	void print_all_memory()
-	{
-		for (uint16_t i = 0; i < 60; i++)
+		if (it->second.size() > 1)
 		{
-			terminal->print(Arch::Terminal::Type::Command, std::to_string(cpu->pmem_read(i)) + " ");
+			terminal->println(Arch::Terminal::Type::Command, "Several processes named " + arg + ", use a pid:\n");
+			for (Process *process : it->second)
+				terminal->println(Arch::Terminal::Type::Command, std::to_string(process->pid) + "\n");
+			return nullptr;
 		}
-		terminal->println(Arch::Terminal::Type::Command, "\n");
+
+		return it->second.front();
 	}
 
-	void sleep(Process *process, uint16_t time_to_sleep)
+	void block(Process *process, WaitQueue &queue);
+	void unblock(Process *process);
+
+	// starts the real-time periods that are due and wakes up the processes waiting for them
+	void release_rt_jobs()
 	{
-		process->state = Process::State::Blocked;
-		process->application_wakeup_time = time(NULL) + time_to_sleep;
+		rt_scheduler.release(cpu->get_cycle());
 
-		ready_processes.remove(process);
+		for (Process *process = rt_scheduler.throttled.front(); process != nullptr;)
+		{
+			Process *next = process->queue_link.next;
 
-		blocked_processes.push_back(process);
+			if (!process->rt.job_done && process->rt.used_ticks < process->rt.budget_ticks)
+				unblock(process);
 
-		terminal->println(Arch::Terminal::Type::Kernel, "Process " + process->name + " going to sleep for " + std::to_string(time_to_sleep) + "\n");
+			process = next;
+		}
 	}
 
-	void wakeup()
+	// the process waits on throttled until its next period
+	void throttle_current()
 	{
-		for (auto it = blocked_processes.begin(); it != blocked_processes.end();)
-		{
-			Process *process = *it;
-			if (process->state == Process::State::Blocked && process->application_wakeup_time <= time(NULL))
-			{
-				process->state = Process::State::Ready;
-
-				it = blocked_processes.erase(it);
+		Process *process = current_process_ptr;
 
-				ready_processes.push_back(process);
+		unschedule_process();
+		block(process, rt_scheduler.throttled);
+		dispatch();
+	}
 
-				ready_processes_begin = ready_processes.begin();
+	void timer_tick()
+	{
+		release_rt_jobs();
 
-				terminal->println(Arch::Terminal::Type::Kernel, "Process " + process->name + " woke up\n");
+		Process *current = current_process_ptr;
 
-				if (current_process_ptr == idle_process_ptr)
-				{
-					unschedule_process();
-					schedule_process(process);
-				}
+		if (current == idle_process_ptr)
+		{
+			if (!rt_scheduler.empty() || !scheduler->empty())
+			{
+				preempt();
+				dispatch();
 			}
-			else
+		}
+		else if (rt_scheduler.is_member(current))
+		{
+			if (rt_scheduler.charge(current))
+				throttle_current();
+			else if (rt_scheduler.has_earlier_deadline(current->rt.deadline_cycle))
 			{
-				++it;
+				preempt();
+				dispatch();
 			}
 		}
+		// real-time processes preempt best-effort ones at the next tick
+		else if (!rt_scheduler.empty() || scheduler->tick(current))
+		{
+			preempt();
+			dispatch();
+		}
 	}
 
-	void kill(Process *process)
+	// includes the time slice of the running process
+	uint64_t cpu_cycles(const Process *process)
 	{
-		if (process->state == Process::State::Running)
-		{
-			panic("Process running");
-		}
+		uint64_t cycles = process->stats.cpu_cycles;
 
-		desallocate_frame(process);
+		if (process == current_process_ptr)
+			cycles += cpu->get_cycle() - process->stats.scheduled_cycle;
+
+		return cycles;
+	}
+
+	// statistics including the slice of the running process, as unschedule_process will account it
+	ProcessStats current_stats(const Process *process)
+	{
+		ProcessStats stats = process->stats;
+
+		if (process == current_process_ptr)
+		{
+			stats.cpu_cycles = cpu_cycles(process);
+			stats.instructions += cpu->get_executed_instructions() - stats.scheduled_instructions;
+			stats.context_switches++;
+		}
+
+		return stats;
+	}
+
+	uint32_t resident_frames(const Process *process)
+	{
+		return std::count_if(process->page_table.frames.begin(), process->page_table.frames.end(), [] (const Arch::PageTableBase &entry) { return entry.valid; });
+	}
+
+	// processes sorted by the cpu time they used since the previous refresh
+	void show_top()
+	{
+		const uint64_t now = cpu->get_cycle();
+		const uint64_t interval = std::max<uint64_t>(now - top_cycle, 1);
+
+		std::vector<std::pair<uint64_t, Process *>> usage;
+
+		usage.emplace_back(cpu_cycles(idle_process_ptr) - idle_process_ptr->stats.top_cpu_cycles, idle_process_ptr);
+
+		for (Process *process : processes)
+			usage.emplace_back(cpu_cycles(process) - process->stats.top_cpu_cycles, process);
+
+		std::sort(usage.begin(), usage.end(), [] (const auto &a, const auto &b) { return a.first > b.first; });
+
+		terminal->println(Arch::Terminal::Type::Command, "top: " + std::to_string(usage.size()) + " processes, " + std::to_string(interval) + " cycles\n");
+
+		for (const auto &[used, process] : usage)
+		{
+			const ProcessStats stats = current_stats(process);
+
+			terminal->println(Arch::Terminal::Type::Command, std::to_string(process->pid) + " " + process->name + " " + std::to_string(used * 100 / interval) + "% " + state_str(process->state) + "\n"
+				+ "  ins " + std::to_string(stats.instructions) + " cs " + std::to_string(stats.context_switches)
+				+ " sys " + std::to_string(stats.syscalls) + " gpf " + std::to_string(stats.gpfs)
+				+ " frm " + std::to_string(resident_frames(process)) + " slp " + std::to_string(stats.sleep_cycles / Config::cycles_per_second) + "s\n");
+
+			if (rt_scheduler.is_member(process))
+				terminal->println(Arch::Terminal::Type::Command, "  rt " + std::to_string(process->rt.budget_ticks) + "/" + std::to_string(process->rt.period_ticks) + " ticks, " + std::to_string(process->rt.deadline_misses) + " misses\n");
+
+			process->stats.top_cpu_cycles += used;
+		}
+
+		top_cycle = now;
+	}
+
+	void list_processes()
+	{
+		terminal->println(Arch::Terminal::Type::Command, "Processes:\n");
+		for (Process *process : processes)
+		{
+			terminal->println(Arch::Terminal::Type::Command, std::to_string(process->pid) + " " + process->name + " " + state_str(process->state) + "\n");
+		}
+	}
+
+	std::string paging_stats()
+	{
+		const uint64_t translations = cpu->get_tlb_hits() + cpu->get_tlb_misses();
+
+		return std::string("machine ") + machine->name + ", page " + std::to_string(machine->page_size_words) + " words, large page " + (Config::large_pages ? std::to_string(Config::large_page_size_words) + " words" : std::string("off"))
+			+ ", tlb " + std::to_string(cpu->get_tlb_hits()) + " hits " + std::to_string(cpu->get_tlb_misses()) + " misses (" + std::to_string(translations ? (cpu->get_tlb_hits() * 100) / translations : 0) + "% hits)"
+			+ ", internal fragmentation " + std::to_string(image_words_mapped - image_words_loaded) + " of " + std::to_string(image_words_mapped) + " mapped words"
+			+ ", verified code pages " + std::to_string(verified_pages) + " of " + std::to_string(code_pages)
+			+ ", zeroed frames " + std::to_string(frames_zeroed_on_alloc) + " on allocation " + std::to_string(frames_zeroed_idle) + " while idle " + std::to_string(frames_needing_zero) + " pending";
+	}
+
+	void print_all_memory()
+	{
+		for (uint16_t i = 0; i < 60; i++)
+		{
+			terminal->print(Arch::Terminal::Type::Command, std::to_string(cpu->pmem_read(i)) + " ");
+		}
+		terminal->println(Arch::Terminal::Type::Command, "\n");
+		terminal->println(Arch::Terminal::Type::Command, paging_stats() + "\n");
+	}
+
+	// time_to_sleep is given in virtual seconds of Config::cycles_per_second cycles
+	void sleep(Process *process, uint16_t time_to_sleep)
+	{
+		process->state = Process::State::Blocked;
+		process->wakeup_cycle = cpu->get_cycle() + uint64_t(time_to_sleep) * Config::cycles_per_second;
+		process->stats.blocked_cycle = cpu->get_cycle();
+
+		sleeping_processes.push(process);
+
+		trace(TraceEvent::Sleep, process, time_to_sleep);
+	}
+
+	// hands a blocked process back to the scheduler, taking the cpu from idle
+	void make_ready(Process *process)
+	{
+		process->state = Process::State::Ready;
+
+		enqueue_ready(process);
+
+		if (current_process_ptr == idle_process_ptr)
+		{
+			unschedule_process();
+			dispatch();
+		}
+	}
+
+	void wakeup()
+	{
+		const uint64_t now = cpu->get_cycle();
+
+		while (!sleeping_processes.empty() && sleeping_processes.front()->wakeup_cycle <= now)
+		{
+			Process *process = sleeping_processes.pop();
+
+			process->stats.sleep_cycles += now - process->stats.blocked_cycle;
+			trace(TraceEvent::Wakeup, process);
+
+			make_ready(process);
+		}
+	}
+
+	// the process must not be running
+	void block(Process *process, WaitQueue &queue)
+	{
+		process->state = Process::State::Blocked;
+		process->wait_queue = &queue;
+		process->stats.blocked_cycle = cpu->get_cycle();
+		queue.push_back(process);
+
+		trace(TraceEvent::Block, process);
+	}
+
+	void unblock(Process *process)
+	{
+		process->wait_queue->remove(process);
+		process->wait_queue = nullptr;
+		process->stats.sleep_cycles += cpu->get_cycle() - process->stats.blocked_cycle;
+
+		trace(TraceEvent::Unblock, process);
+
+		make_ready(process);
+	}
+
+	// duplicates the running process
+	// frames are shared read-only and copied by write_fault on the first store
+	// returns nullptr if the process pool is exhausted
+	Process *fork_process()
+	{
+		Process *parent = current_process_ptr;
+		Process *child = process_pool.alloc();
+
+		if (child == nullptr)
+		{
+			terminal->println(Arch::Terminal::Type::Kernel, "Too many processes\n");
+			return nullptr;
+		}
+
+		*child = *parent;
+		child->pid = alloc_pid(child);
+		child->state = Process::State::Ready;
+		child->start_cycle = cpu->get_cycle();
+		child->pc = cpu->get_pc();
+
+		for (uint32_t i = 0; i < machine->nregs; i++)
+			child->registers[i] = cpu->get_gpr(i);
+
+		for (uint32_t i = 0; i < Config::vector_regs; i++)
+			child->vregs[i] = cpu->get_vreg(i);
+
+		// the child sees 0 as the return value, the parent sees the child's pid
+		child->registers[1] = 0;
+
+		// the ring is not inherited, otherwise its submissions would run twice
+		child->ring = AsyncRing();
+		child->stats = ProcessStats();
+
+		// pending keystrokes were typed to the parent, they must not be read twice
+		child->input = {};
+
+		// a reservation is not inherited, the child would have to pass admission control
+		child->rt = RealTime();
+
+		for (uint32_t i = 0; i < parent->page_table.frames.size(); i++)
+		{
+			Arch::PageTableBase &entry = parent->page_table.frames[i];
+
+			if (!entry.valid)
+				continue;
+
+			// shared memory stays shared, everything else is copied on write
+			if (entry.shared)
+			{
+				share_frame(entry.frame_number);
+				continue;
+			}
+
+			// read-only sections are never copied
+			if (!entry.writable && !entry.cow && !entry.write_trap)
+			{
+				free_frames[entry.frame_number].refs++;
+				continue;
+			}
+
+			entry.writable = false;
+			entry.cow = true;
+			child->page_table.frames[i] = entry;
+			free_frames[entry.frame_number].refs++;
+		}
+
+		register_process(child);
+		enqueue_ready(child);
+
+		trace(TraceEvent::Fork, parent, child->pid);
+
+		return child;
+	}
+
+	// gives the process a private copy of a copy-on-write page
+	bool break_cow(Process *process, const uint32_t page_number)
+	{
+		Arch::PageTableBase &entry = process->page_table.frames[page_number];
+
+		// last user of a shared frame can simply take it back
+		if (free_frames[entry.frame_number].refs > 1)
+		{
+			const bool zero_page = (entry.frame_number == zero_page_frame);
+			const uint32_t frame_number = allocate_frame(process, zero_page);
+
+			if (frame_number == no_frame)
+			{
+				terminal->println(Arch::Terminal::Type::Kernel, "Not enough frames to copy page\n");
+				return false;
+			}
+
+			const uint32_t src = entry.frame_number * machine->page_size_words;
+			const uint32_t dest = frame_number * machine->page_size_words;
+
+			if (!zero_page)
+				std::copy_n(cpu->pmem_span(src, machine->page_size_words), machine->page_size_words, cpu->pmem_span(dest, machine->page_size_words));
+
+			release_frame(entry.frame_number);
+			entry.frame_number = frame_number;
+
+			// the large page no longer maps contiguous frames, its pages are translated one by one
+			process->page_table.large_frames[page_number / frames_per_large_page()].valid = false;
+
+			if (process == current_process_ptr)
+				cpu->flush_tlb();
+		}
+
+		entry.writable = true;
+		entry.cow = false;
+
+		return true;
+	}
+
+	// first store to a page mapped without write permission, returns false if the page is read-only
+	bool make_writable(Process *process, const uint32_t page_number)
+	{
+		Arch::PageTableBase &entry = process->page_table.frames[page_number];
+
+		// the store may turn verified code into anything
+		if (entry.write_trap)
+		{
+			entry.write_trap = false;
+			entry.verified = false;
+			entry.writable = !entry.cow;
+		}
+
+		return entry.writable || (entry.cow && break_cow(process, page_number));
+	}
+
+	bool write_fault(const uint16_t vaddr)
+	{
+		return make_writable(current_process_ptr, vaddr / machine->page_size_words);
+	}
+
+	// Calls fn(ptr, n) for each physically contiguous piece of [vaddr, vaddr + len) in the address space of a process,
+	// so the kernel translates once per page instead of once per word.
+	// fn returns false to stop early.
+	// Returns false at the first unmapped page, or read-only page when writing.
+	template <typename T>
+	bool for_each_user_span(Process *process, uint32_t vaddr, uint32_t len, const bool write, T fn)
+	{
+		while (len > 0)
+		{
+			if (vaddr >= Config::virtual_space_size)
+				return false;
+
+			const uint32_t page_number = vaddr / machine->page_size_words;
+			Arch::PageTableBase &entry = process->page_table.frames[page_number];
+
+			if (!entry.valid)
+				return false;
+
+			if (write && !entry.writable && !make_writable(process, page_number))
+				return false;
+
+			const uint32_t offset = vaddr % machine->page_size_words;
+			const uint32_t n = std::min(len, machine->page_size_words - offset);
+
+			if (!fn(cpu->pmem_span(entry.frame_number * machine->page_size_words + offset, n), n))
+				return true;
+
+			vaddr += n;
+			len -= n;
+		}
+
+		return true;
+	}
+
+	bool copy_to_user(Process *process, const uint16_t vaddr, const uint16_t *src, const uint32_t len)
+	{
+		return for_each_user_span(process, vaddr, len, true, [&src] (uint16_t *span, const uint32_t n) {
+			src = std::copy_n(src, n, span);
+			return true;
+		});
+	}
+
+	bool copy_from_user(Process *process, const uint16_t vaddr, uint16_t *dest, const uint32_t len)
+	{
+		return for_each_user_span(process, vaddr, len, false, [&dest] (uint16_t *span, const uint32_t n) {
+			dest = std::copy_n(span, n, dest);
+			return true;
+		});
+	}
+
+	// appends the len characters at vaddr to str, translating once per page
+	bool read_user_chars(Process *process, const uint16_t vaddr, const uint32_t len, std::string &str)
+	{
+		str.reserve(str.size() + len);
+
+		return for_each_user_span(process, vaddr, len, false, [&str] (const uint16_t *span, const uint32_t n) {
+			std::transform(span, span + n, std::back_inserter(str), [] (const uint16_t c) { return static_cast<char>(c); });
+			return true;
+		});
+	}
+
+	// same as read_user_chars, but stops at the terminating 0 of the string
+	bool read_user_string(Process *process, const uint16_t vaddr, const uint32_t max_len, std::string &str)
+	{
+		return for_each_user_span(process, vaddr, max_len, false, [&str] (const uint16_t *span, const uint32_t n) {
+			const uint16_t *end = std::find(span, span + n, 0);
+			std::transform(span, end, std::back_inserter(str), [] (const uint16_t c) { return static_cast<char>(c); });
+			return end == span + n;
+		});
+	}
+
+	// Syscalls that may have to wait.
+	// They either complete, storing the value for r1 in result and returning nullptr,
+	// or return the queue to wait on. A waiting syscall is retried with the saved registers
+	// when its queue is woken, so the blocked process resumes with the syscall done.
+
+	// 10: reads one character
+	// 11: reads a line into vaddr, at most max_len words including the terminating 0, the newline is dropped
+	WaitQueue *read_input(Process *process, const uint16_t syscall, const uint16_t vaddr, const uint16_t max_len, uint16_t &result)
+	{
+		auto &input = process->input;
+
+		if (syscall == 10)
+		{
+			if (input.empty())
+				return &input_waiters;
+
+			result = input.pop();
+			return nullptr;
+		}
+
+		if (max_len == 0)
+		{
+			result = 0;
+			return nullptr;
+		}
+
+		uint32_t len = 0;
+
+		while (len < input.size() && input[len] != '\n')
+			len++;
+
+		const bool has_line = (len < input.size());
+
+		if (!has_line && !input.full() && len < max_len - 1u)
+			return &input_waiters;
+
+		// the input is only consumed once the line reached the user buffer
+		std::array<uint16_t, Config::input_buffer_size + 1> line;
+		const uint32_t n = input.peek(line.data(), std::min<uint32_t>(len, max_len - 1u));
+
+		line[n] = 0;
+
+		if (!copy_to_user(process, vaddr, line.data(), n + 1))
+		{
+			result = syscall_error;
+			return nullptr;
+		}
+
+		input.drop((n == len && has_line) ? n + 1 : n);
+
+		result = n;
+
+		return nullptr;
+	}
+
+	Pipe *get_pipe(const uint16_t id)
+	{
+		return (id < pipes.size() && pipes[id].used) ? &pipes[id] : nullptr;
+	}
+
+	MessageQueue *get_message_queue(const uint16_t id)
+	{
+		return (id < message_queues.size() && message_queues[id].used) ? &message_queues[id] : nullptr;
+	}
+
+	void wake_waiters(WaitQueue &queue);
+
+	// reads up to len words, waiting while the pipe is empty
+	// returns 0 once a closed pipe is drained, its slot is then released, so unknown ids also read as end of file
+	WaitQueue *pipe_read(Process *process, const uint16_t id, const uint16_t vaddr, const uint16_t len, uint16_t &result)
+	{
+		Pipe *pipe = get_pipe(id);
+
+		if (pipe == nullptr)
+		{
+			result = 0;
+			return nullptr;
+		}
+
+		if (pipe->buffer.empty() && !pipe->closed)
+			return &pipe->readers;
+
+		const uint32_t n = std::min<uint32_t>(len, pipe->buffer.size());
+		uint32_t moved = 0;
+
+		// words are only popped into mapped pages, a fault after some of them returns their count
+		const bool ok = for_each_user_span(process, vaddr, n, true, [pipe, &moved] (uint16_t *span, const uint32_t k) {
+			pipe->buffer.pop(span, k);
+			moved += k;
+			return true;
+		});
+
+		if (!ok && moved == 0)
+		{
+			result = syscall_error;
+			return nullptr;
+		}
+
+		result = moved;
+
+		pipe->words += moved;
+		pipe->transfers++;
+
+		if (pipe->closed && pipe->buffer.empty())
+			pipe->used = false;
+		else
+			wake_waiters(pipe->writers);
+
+		return nullptr;
+	}
+
+	// writes up to len words, waiting while the pipe is full
+	WaitQueue *pipe_write(Process *process, const uint16_t id, const uint16_t vaddr, const uint16_t len, uint16_t &result)
+	{
+		Pipe *pipe = get_pipe(id);
+
+		if (pipe == nullptr || pipe->closed)
+		{
+			result = syscall_error;
+			return nullptr;
+		}
+
+		if (pipe->buffer.full() && len > 0)
+			return &pipe->writers;
+
+		const uint32_t n = std::min<uint32_t>(len, pipe->buffer.free_space());
+		uint32_t moved = 0;
+
+		// the words of the pages before a fault stay in the pipe, so their count is returned
+		const bool ok = for_each_user_span(process, vaddr, n, false, [pipe, &moved] (uint16_t *span, const uint32_t k) {
+			pipe->buffer.push(span, k);
+			moved += k;
+			return true;
+		});
+
+		if (!ok && moved == 0)
+		{
+			result = syscall_error;
+			return nullptr;
+		}
+
+		result = moved;
+
+		pipe->words += moved;
+		pipe->transfers++;
+
+		wake_waiters(pipe->readers);
+
+		return nullptr;
+	}
+
+	// sends one message of len words, waiting while the queue is full
+	WaitQueue *mq_send(Process *process, const uint16_t id, const uint16_t vaddr, const uint16_t len, uint16_t &result)
+	{
+		MessageQueue *mq = get_message_queue(id);
+
+		if (mq == nullptr || mq->closed || len > Config::mq_message_words)
+		{
+			result = syscall_error;
+			return nullptr;
+		}
+
+		if (mq->messages.full())
+			return &mq->senders;
+
+		// copied before it is queued, a fault sends nothing
+		Message message;
+		message.len = len;
+
+		if (!copy_from_user(process, vaddr, message.data.data(), len))
+		{
+			result = syscall_error;
+			return nullptr;
+		}
+
+		mq->messages.push_slot() = message;
+
+		result = len;
+
+		mq->words += len;
+		mq->transfers++;
+
+		wake_waiters(mq->receivers);
+
+		return nullptr;
+	}
+
+	// receives one message, truncated to max_len words, waiting while the queue is empty
+	// returns 0 once a closed queue is drained, with the same slot rules as pipe_read
+	WaitQueue *mq_receive(Process *process, const uint16_t id, const uint16_t vaddr, const uint16_t max_len, uint16_t &result)
+	{
+		MessageQueue *mq = get_message_queue(id);
+
+		if (mq == nullptr)
+		{
+			result = 0;
+			return nullptr;
+		}
+
+		if (mq->messages.empty())
+		{
+			if (!mq->closed)
+				return &mq->receivers;
+
+			mq->used = false;
+			result = 0;
+			return nullptr;
+		}
+
+		const Message &message = mq->messages.front();
+		const uint16_t n = std::min(message.len, max_len);
+
+		// a fault leaves the message queued for the next receive
+		if (!copy_to_user(process, vaddr, message.data.data(), n))
+		{
+			result = syscall_error;
+			return nullptr;
+		}
+
+		result = n;
+
+		mq->messages.pop();
+
+		wake_waiters(mq->senders);
+
+		return nullptr;
+	}
+
+	// File system. Block 0 holds the directory, kept in memory and written back on close and sync.
+	// File i owns the fs_file_blocks blocks starting at 1 + i * fs_file_blocks.
+	// Data blocks go through the buffer cache: dirty buffers are written back when evicted or synced,
+	// and a read miss also prefetches the next blocks of the file.
+
+	inline constexpr uint32_t dir_entry_words = 2 + Config::fs_name_words;
+	inline constexpr uint32_t max_file_words = Config::fs_file_blocks * Config::disk_block_words;
+
+	void read_directory()
+	{
+		std::array<uint16_t, Config::disk_block_words> block;
+
+		disk->read_now(0, block.data());
+
+		for (uint32_t i = 0; i < directory.size(); i++)
+		{
+			const uint16_t *raw = block.data() + i * dir_entry_words;
+
+			directory[i].used = (raw[0] != 0);
+			directory[i].size = std::min<uint32_t>(raw[1], max_file_words);
+			std::copy_n(raw + 2, Config::fs_name_words, directory[i].name.begin());
+			directory[i].name.back() = 0;
+		}
+	}
+
+	void write_directory()
+	{
+		std::array<uint16_t, Config::disk_block_words> block = {};
+
+		for (uint32_t i = 0; i < directory.size(); i++)
+		{
+			uint16_t *raw = block.data() + i * dir_entry_words;
+
+			raw[0] = directory[i].used;
+			raw[1] = directory[i].size;
+			std::copy(directory[i].name.begin(), directory[i].name.end(), raw + 2);
+		}
+
+		disk->write_now(0, block.data());
+		directory_dirty = false;
+	}
+
+	std::string file_name(const DirEntry &entry)
+	{
+		std::string name;
+
+		for (uint32_t i = 0; i < entry.name.size() && entry.name[i] != 0; i++)
+			name += static_cast<char>(entry.name[i]);
+
+		return name;
+	}
+
+	uint32_t file_block(const uint16_t file, const uint32_t offset)
+	{
+		return 1 + file * Config::fs_file_blocks + offset / Config::disk_block_words;
+	}
+
+	OpenFile *get_open_file(Process *process, const uint16_t fd)
+	{
+		return (fd < process->files.size() && process->files[fd].used) ? &process->files[fd] : nullptr;
+	}
+
+	void start_disk_request()
+	{
+		if (disk_requests.empty() || disk->is_busy())
+			return;
+
+		const DiskRequest &request = disk_requests.front();
+
+		if (request.write)
+			disk->write(request.buffer->block, request.buffer->data.data());
+		else
+			disk->read(request.buffer->block, request.buffer->data.data());
+	}
+
+	void queue_disk_request(Buffer *buffer, const bool write)
+	{
+		buffer->busy = true;
+
+		if (write)
+			buffer_cache.stats.write_backs++;
+
+		disk_requests.push_back({buffer, write});
+		start_disk_request();
+	}
+
+	// takes the least recently used buffer for block, starting the write-back of dirty ones on the way
+	// returns nullptr if every buffer is busy, a disk interrupt will free one
+	Buffer *evict(const uint32_t block)
+	{
+		Buffer *buffer;
+
+		while ((buffer = buffer_cache.victim()) != nullptr && buffer->dirty)
+			queue_disk_request(buffer, true);
+
+		if (buffer != nullptr)
+			buffer_cache.assign(buffer, block);
+
+		return buffer;
+	}
+
+	// returns the buffer holding block, or nullptr after starting what is needed to get it
+	// load is false when the block content is not needed, the buffer is then zero filled
+	Buffer *get_block(const uint32_t block, const bool load)
+	{
+		Buffer *buffer = buffer_cache.find(block);
+
+		if (buffer == nullptr)
+		{
+			buffer = evict(block);
+
+			if (buffer == nullptr)
+				return nullptr;
+
+			buffer_cache.stats.misses++;
+			buffer->missed = true;
+
+			if (load)
+			{
+				queue_disk_request(buffer, false);
+				return nullptr;
+			}
+
+			buffer->data.fill(0);
+			buffer->valid = true;
+		}
+
+		return buffer->valid ? buffer : nullptr;
+	}
+
+	// starts loading the blocks after offset, using only clean buffers
+	void read_ahead(const uint16_t file, const uint32_t offset)
+	{
+		const DirEntry &entry = directory[file];
+		uint32_t next = offset - offset % Config::disk_block_words;
+
+		for (uint32_t i = 0; i < Config::cache_read_ahead_blocks; i++)
+		{
+			next += Config::disk_block_words;
+
+			if (next >= entry.size)
+				break;
+
+			const uint32_t block = file_block(file, next);
+
+			if (buffer_cache.find(block) != nullptr)
+				continue;
+
+			Buffer *buffer = buffer_cache.victim();
+
+			if (buffer == nullptr || buffer->dirty)
+				break;
+
+			buffer_cache.assign(buffer, block);
+			buffer->prefetched = true;
+			buffer_cache.stats.read_ahead++;
+			queue_disk_request(buffer, false);
+		}
+	}
+
+	// flags: 1 creates the file if it does not exist
+	// returns the file descriptor
+	uint16_t file_open(Process *process, const uint16_t vaddr, const uint16_t flags)
+	{
+		std::string name;
+
+		if (!read_user_string(process, vaddr, Config::fs_name_words, name) || name.empty() || name.size() >= Config::fs_name_words)
+			return syscall_error;
+
+		auto fd = std::find_if(process->files.begin(), process->files.end(), [] (const OpenFile &file) { return !file.used; });
+
+		if (fd == process->files.end())
+			return syscall_error;
+
+		auto entry = std::find_if(directory.begin(), directory.end(), [&name] (const DirEntry &entry) { return entry.used && file_name(entry) == name; });
+
+		if (entry == directory.end())
+		{
+			if (!(flags & 1))
+				return syscall_error;
+
+			entry = std::find_if(directory.begin(), directory.end(), [] (const DirEntry &entry) { return !entry.used; });
+
+			if (entry == directory.end())
+				return syscall_error;
+
+			*entry = DirEntry();
+			entry->used = true;
+			std::copy(name.begin(), name.end(), entry->name.begin());
+			directory_dirty = true;
+		}
+
+		*fd = {true, static_cast<uint16_t>(entry - directory.begin()), 0};
+
+		return fd - process->files.begin();
+	}
+
+	// reads up to len words at the file offset, stopping at the end of the block
+	// returns 0 at the end of the file
+	WaitQueue *file_read(Process *process, const uint16_t fd, const uint16_t vaddr, const uint16_t len, uint16_t &result)
+	{
+		OpenFile *file = get_open_file(process, fd);
+
+		if (file == nullptr)
+		{
+			result = syscall_error;
+			return nullptr;
+		}
+
+		const DirEntry &entry = directory[file->file];
+		const uint32_t block_offset = file->offset % Config::disk_block_words;
+
+		if (file->offset >= entry.size || len == 0)
+		{
+			result = 0;
+			return nullptr;
+		}
+
+		const uint32_t n = std::min<uint32_t>({len, static_cast<uint32_t>(entry.size - file->offset), Config::disk_block_words - block_offset});
+		const uint32_t block = file_block(file->file, file->offset);
+		const bool miss = (buffer_cache.find(block) == nullptr);
+
+		Buffer *buffer = get_block(block, true);
+
+		if (miss && buffer_cache.find(block) != nullptr)
+			read_ahead(file->file, file->offset);
+
+		if (buffer == nullptr)
+			return &disk_waiters;
+
+		buffer_cache.use(buffer);
+
+		if (!copy_to_user(process, vaddr, buffer->data.data() + block_offset, n))
+		{
+			result = syscall_error;
+			return nullptr;
+		}
+
+		file->offset += n;
+		result = n;
+
+		return nullptr;
+	}
+
+	// writes up to len words at the file offset, stopping at the end of the block
+	// returns 0 once the file reached its maximum size
+	WaitQueue *file_write(Process *process, const uint16_t fd, const uint16_t vaddr, const uint16_t len, uint16_t &result)
+	{
+		OpenFile *file = get_open_file(process, fd);
+
+		if (file == nullptr)
+		{
+			result = syscall_error;
+			return nullptr;
+		}
+
+		DirEntry &entry = directory[file->file];
+		const uint32_t block_offset = file->offset % Config::disk_block_words;
+		const uint32_t n = std::min<uint32_t>({len, max_file_words - file->offset, Config::disk_block_words - block_offset});
+
+		if (n == 0)
+		{
+			result = 0;
+			return nullptr;
+		}
+
+		// copied before the buffer is touched, a fault must not leave a zero filled or half written block cached
+		std::array<uint16_t, Config::disk_block_words> words;
+
+		if (!copy_from_user(process, vaddr, words.data(), n))
+		{
+			result = syscall_error;
+			return nullptr;
+		}
+
+		// blocks past the end of the file and fully overwritten ones are not read
+		const bool load = (file->offset - block_offset < entry.size) && (n < Config::disk_block_words);
+
+		Buffer *buffer = get_block(file_block(file->file, file->offset), load);
+
+		// a buffer being written back cannot change
+		if (buffer == nullptr || buffer->busy)
+			return &disk_waiters;
+
+		buffer_cache.use(buffer);
+
+		std::copy_n(words.data(), n, buffer->data.data() + block_offset);
+		buffer->dirty = true;
+		file->offset += n;
+
+		if (file->offset > entry.size)
+		{
+			entry.size = file->offset;
+			directory_dirty = true;
+		}
+
+		result = n;
+
+		return nullptr;
+	}
+
+	WaitQueue *blocking_syscall(Process *process, const std::array<uint16_t, Config::max_nregs> &regs, uint16_t &result)
+	{
+		switch (regs[0])
+		{
+		case 10:
+		case 11:
+			return read_input(process, regs[0], regs[1], regs[2], result);
+
+		case 13:
+			return pipe_write(process, regs[1], regs[2], regs[3], result);
+
+		case 14:
+			return pipe_read(process, regs[1], regs[2], regs[3], result);
+
+		case 17:
+			return mq_send(process, regs[1], regs[2], regs[3], result);
+
+		case 18:
+			return mq_receive(process, regs[1], regs[2], regs[3], result);
+
+		case 29:
+			return file_read(process, regs[1], regs[2], regs[3], result);
+
+		case 30:
+			return file_write(process, regs[1], regs[2], regs[3], result);
+		}
+
+		result = syscall_error;
+		return nullptr;
+	}
+
+	// retries the syscall a blocked process is waiting on
+	// returns false if it still has to wait
+	bool retry_syscall(Process *process)
+	{
+		uint16_t result;
+
+		if (blocking_syscall(process, process->registers, result) != nullptr)
+			return false;
+
+		process->registers[1] = result;
+		unblock(process);
+
+		return true;
+	}
+
+	// waiters are served in order, stopping at the first one that still has to wait
+	void wake_waiters(WaitQueue &queue)
+	{
+		while (!queue.empty() && retry_syscall(queue.front()))
+			;
+	}
+
+	// retries every waiter, for queues whose waiters wait on different things
+	void wake_all_waiters(WaitQueue &queue)
+	{
+		for (Process *process = queue.front(); process != nullptr;)
+		{
+			Process *next = process->queue_link.next;
+			retry_syscall(process);
+			process = next;
+		}
+	}
+
+	void disk_interrupt()
+	{
+		const DiskRequest request = disk_requests.front();
+		disk_requests.pop_front();
+
+		request.buffer->busy = false;
+
+		if (request.write)
+			request.buffer->dirty = false;
+		else
+			request.buffer->valid = true;
+
+		start_disk_request();
+		wake_all_waiters(disk_waiters);
+	}
+
+	uint16_t file_close(Process *process, const uint16_t fd)
+	{
+		OpenFile *file = get_open_file(process, fd);
+
+		if (file == nullptr)
+			return syscall_error;
+
+		file->used = false;
+
+		if (directory_dirty)
+			write_directory();
+
+		return 0;
+	}
+
+	// starts the write-back of every dirty buffer, returns how many
+	uint32_t sync_files()
+	{
+		uint32_t n = 0;
+
+		for (Buffer &buffer : buffer_cache.get_buffers())
+		{
+			if (buffer.dirty && !buffer.busy)
+			{
+				queue_disk_request(&buffer, true);
+				n++;
+			}
+		}
+
+		if (directory_dirty)
+			write_directory();
+
+		return n;
+	}
+
+	void list_files()
+	{
+		terminal->println(Arch::Terminal::Type::Command, "Files:\n");
+
+		for (const DirEntry &entry : directory)
+		{
+			if (entry.used)
+				terminal->println(Arch::Terminal::Type::Command, file_name(entry) + ": " + std::to_string(entry.size) + " words\n");
+		}
+	}
+
+	void show_cache()
+	{
+		const CacheStats &stats = buffer_cache.stats;
+		const uint64_t accesses = stats.hits + stats.misses;
+		const uint32_t dirty = std::count_if(buffer_cache.get_buffers().begin(), buffer_cache.get_buffers().end(), [] (const Buffer &buffer) { return buffer.dirty; });
+
+		terminal->println(Arch::Terminal::Type::Command, "Buffer cache: " + std::to_string(buffer_cache.size()) + "/" + std::to_string(Config::cache_blocks) + " blocks, " + std::to_string(dirty) + " dirty, " + std::to_string(disk_requests.size()) + " disk requests queued\n");
+		terminal->println(Arch::Terminal::Type::Command, std::to_string(stats.hits) + " hits, " + std::to_string(stats.misses) + " misses, hit ratio " + std::to_string(accesses ? (stats.hits * 100) / accesses : 0) + "%\n");
+		terminal->println(Arch::Terminal::Type::Command, std::to_string(stats.read_ahead) + " blocks read ahead, " + std::to_string(stats.read_ahead_hits) + " used, " + std::to_string(stats.write_backs) + " write-backs\n");
+	}
+
+	uint16_t pipe_create()
+	{
+		for (uint16_t id = 0; id < pipes.size(); id++)
+		{
+			Pipe &pipe = pipes[id];
+
+			if (!pipe.used)
+			{
+				pipe.used = true;
+				pipe.closed = false;
+				pipe.created_cycle = cpu->get_cycle();
+				pipe.words = 0;
+				pipe.transfers = 0;
+
+				return id;
+			}
+		}
+
+		return syscall_error;
+	}
+
+	uint16_t pipe_close(const uint16_t id)
+	{
+		Pipe *pipe = get_pipe(id);
+
+		if (pipe == nullptr || pipe->closed)
+			return syscall_error;
+
+		pipe->closed = true;
+
+		wake_waiters(pipe->readers);
+		wake_waiters(pipe->writers);
+
+		if (pipe->buffer.empty())
+			pipe->used = false;
+
+		return 0;
+	}
+
+	uint16_t mq_create()
+	{
+		for (uint16_t id = 0; id < message_queues.size(); id++)
+		{
+			MessageQueue &mq = message_queues[id];
+
+			if (!mq.used)
+			{
+				mq.used = true;
+				mq.closed = false;
+				mq.created_cycle = cpu->get_cycle();
+				mq.words = 0;
+				mq.transfers = 0;
+
+				return id;
+			}
+		}
+
+		return syscall_error;
+	}
+
+	uint16_t mq_close(const uint16_t id)
+	{
+		MessageQueue *mq = get_message_queue(id);
+
+		if (mq == nullptr || mq->closed)
+			return syscall_error;
+
+		mq->closed = true;
+
+		wake_waiters(mq->receivers);
+		wake_waiters(mq->senders);
+
+		if (mq->messages.empty())
+			mq->used = false;
+
+		return 0;
+	}
+
+	// returns the id of the segment with this key, creating it with at least size words if needed
+	uint16_t shm_get(const uint16_t key, const uint16_t size)
+	{
+		const uint32_t npages = (size + machine->page_size_words - 1) / machine->page_size_words;
+
+		if (npages == 0 || npages > Config::shm_max_pages)
+			return syscall_error;
+
+		for (uint16_t id = 0; id < shared_segments.size(); id++)
+		{
+			SharedSegment &segment = shared_segments[id];
+
+			if (segment.used && segment.key == key)
+				return (segment.npages >= npages) ? id : syscall_error;
+		}
+
+		for (uint16_t id = 0; id < shared_segments.size(); id++)
+		{
+			SharedSegment &segment = shared_segments[id];
+
+			if (segment.used)
+				continue;
+
+			for (uint32_t i = 0; i < npages; i++)
+			{
+				const uint32_t frame_number = allocate_frame(nullptr);
+
+				if (frame_number == no_frame)
+				{
+					terminal->println(Arch::Terminal::Type::Kernel, "Not enough frames for shared memory\n");
+
+					for (uint32_t j = 0; j < i; j++)
+						release_frame(segment.frames[j]);
+
+					return syscall_error;
+				}
+
+				segment.frames[i] = frame_number;
+			}
+
+			segment.used = true;
+			segment.key = key;
+			segment.npages = npages;
+			segment.users = 0;
+
+			return id;
+		}
+
+		return syscall_error;
+	}
+
+	// maps the segment at the page aligned vaddr, which must not be in use
+	uint16_t shm_attach(Process *process, const uint16_t id, const uint16_t vaddr)
+	{
+		if (id >= shared_segments.size() || !shared_segments[id].used || (vaddr % machine->page_size_words) != 0)
+			return syscall_error;
+
+		SharedSegment &segment = shared_segments[id];
+		auto &frames = process->page_table.frames;
+		const uint32_t first_page = vaddr / machine->page_size_words;
+
+		if (first_page + segment.npages > frames.size())
+			return syscall_error;
+
+		for (uint32_t i = 0; i < segment.npages; i++)
+		{
+			if (frames[first_page + i].valid)
+				return syscall_error;
+		}
+
+		for (uint32_t i = 0; i < segment.npages; i++)
+		{
+			frames[first_page + i] = {segment.frames[i], true, true, false, true};
+			share_frame(segment.frames[i]);
+		}
+
+		return vaddr;
+	}
+
+	// unmaps the segment attached at vaddr
+	uint16_t shm_detach(Process *process, const uint16_t vaddr)
+	{
+		auto &frames = process->page_table.frames;
+		const uint32_t first_page = vaddr / machine->page_size_words;
+		const Arch::PageTableBase &first = frames[first_page];
+
+		if ((vaddr % machine->page_size_words) != 0 || !first.valid || !first.shared)
+			return syscall_error;
+
+		SharedSegment *segment = find_segment(first.frame_number);
+
+		if (segment == nullptr || segment->frames[0] != first.frame_number)
+			return syscall_error;
+
+		// the first frame goes last, it may destroy the segment
+		for (uint32_t i = segment->npages; i-- > 0;)
+		{
+			release_shared_frame(frames[first_page + i].frame_number);
+			frames[first_page + i].valid = false;
+		}
+
+		if (process == current_process_ptr)
+			cpu->flush_tlb();
+
+		return 0;
+	}
+
+	void list_ipc()
+	{
+		const uint64_t now = cpu->get_cycle();
+
+		auto stats = [now] (const auto &object) {
+			const uint64_t kcycles = std::max<uint64_t>((now - object.created_cycle) / 1024, 1);
+			return std::to_string(object.words) + " words in " + std::to_string(object.transfers) + " transfers, "
+				+ std::to_string(object.words / kcycles) + " words/kcycle" + (object.closed ? ", closed" : "");
+		};
+
+		terminal->println(Arch::Terminal::Type::Command, "IPC:\n");
+
+		for (uint32_t id = 0; id < pipes.size(); id++)
+		{
+			if (pipes[id].used)
+				terminal->println(Arch::Terminal::Type::Command, "pipe " + std::to_string(id) + ": " + std::to_string(pipes[id].buffer.size()) + " buffered, " + stats(pipes[id]) + "\n");
+		}
+
+		for (uint32_t id = 0; id < message_queues.size(); id++)
+		{
+			if (message_queues[id].used)
+				terminal->println(Arch::Terminal::Type::Command, "mq " + std::to_string(id) + ": " + std::to_string(message_queues[id].messages.size()) + " queued, " + stats(message_queues[id]) + "\n");
+		}
+
+		for (uint32_t id = 0; id < shared_segments.size(); id++)
+		{
+			const SharedSegment &segment = shared_segments[id];
+
+			if (segment.used)
+				terminal->println(Arch::Terminal::Type::Command, "shm " + std::to_string(id) + ": key " + std::to_string(segment.key) + ", " + std::to_string(segment.npages) + " pages, " + std::to_string(segment.users) + " users\n");
+		}
+	}
+
+	// Asynchronous syscall ring, registered with syscall 24 at vaddr with entries slots (a power of 2):
+	//   [0] submission head (kernel)   [1] submission tail (guest)
+	//   [2] completion head (guest)    [3] completion tail (kernel)
+	//   then entries submissions of 4 words: syscall, r1, r2, r3
+	//   then entries completions of 2 words: submission index, result
+	// Indexes run freely and wrap at 2^16, slots are taken modulo entries.
+	// Submissions run in order at every timer tick, one that has to wait holds back the ones behind it.
+
+	void set_nice(Process *process, const uint16_t nice);
+
+	inline constexpr uint32_t ring_header_words = 4;
+	inline constexpr uint32_t ring_submission_words = 4;
+	inline constexpr uint32_t ring_completion_words = 2;
+
+	uint16_t ring_setup(Process *process, const uint16_t vaddr, const uint16_t entries)
+	{
+		if (entries == 0)
+		{
+			ring_processes.remove(process);
+			process->ring = AsyncRing();
+			return 0;
+		}
+
+		const uint32_t size = ring_header_words + entries * (ring_submission_words + ring_completion_words);
+
+		if (entries > Config::async_ring_max_entries || (entries & (entries - 1)) != 0 || vaddr + size > Config::virtual_space_size)
+			return syscall_error;
+
+		process->ring = AsyncRing();
+		process->ring.vaddr = vaddr;
+		process->ring.entries = entries;
+		process->ring.pending = true;
+
+		if (!ring_processes.contains(process))
+			ring_processes.push_back(process);
+
+		return 0;
+	}
+
+	// runs one submission, returns false if it has to wait
+	// output of the print syscalls is appended to output, so a whole batch is printed at once
+	bool ring_call(Process *process, const std::array<uint16_t, ring_submission_words> &sqe, std::string &output, uint16_t &result)
+	{
+		result = 0;
+
+		switch (sqe[0])
+		{
+		case 1:
+			if (!read_user_string(process, sqe[1], Config::virtual_space_size - sqe[1], output))
+				result = syscall_error;
+			break;
+
+		// same output as the synchronous syscalls
+		case 2:
+			output += "\n\n";
+			break;
+
+		case 3:
+			output += std::to_string(sqe[1]) + "\n";
+			break;
+
+		case 6:
+		{
+			AsyncRing &ring = process->ring;
+
+			if (!ring.sleeping)
+			{
+				ring.sleeping = true;
+				ring.wakeup_cycle = cpu->get_cycle() + uint64_t(sqe[1]) * Config::cycles_per_second;
+			}
+
+			if (cpu->get_cycle() < ring.wakeup_cycle)
+				return false;
+
+			ring.sleeping = false;
+			break;
+		}
+
+		case 7:
+			result = (cpu->get_cycle() - process->start_cycle) / Config::cycles_per_second;
+			break;
+
+		case 9:
+			set_nice(process, sqe[1]);
+			break;
+
+		case 10:
+		case 11:
+		case 13:
+		case 14:
+		case 17:
+		case 18:
+		case 29:
+		case 30:
+		{
+			std::array<uint16_t, Config::max_nregs> regs = {};
+
+			std::copy(sqe.begin(), sqe.end(), regs.begin());
+
+			return blocking_syscall(process, regs, result) == nullptr;
+		}
+
+		case 12:
+			result = pipe_create();
+			break;
+
+		case 15:
+			result = pipe_close(sqe[1]);
+			break;
+
+		case 16:
+			result = mq_create();
+			break;
+
+		case 19:
+			result = mq_close(sqe[1]);
+			break;
+
+		case 20:
+			result = shm_get(sqe[1], sqe[2]);
+			break;
+
+		case 21:
+			result = shm_attach(process, sqe[1], sqe[2]);
+			break;
+
+		case 22:
+			result = shm_detach(process, sqe[1]);
+			break;
+
+		case 23:
+			result = read_user_chars(process, sqe[1], sqe[2], output) ? sqe[2] : syscall_error;
+			break;
+
+		case 28:
+			result = file_open(process, sqe[1], sqe[2]);
+			break;
+
+		case 31:
+			result = file_close(process, sqe[1]);
+			break;
+
+		// exit, fork and the ring syscalls need the cpu context of the process
+		default:
+			result = syscall_error;
+		}
+
+		return true;
+	}
+
+	// runs up to async_ring_batch submissions of the ring, returns how many completed
+	uint16_t drain_ring(Process *process)
+	{
+		AsyncRing &ring = process->ring;
+		std::array<uint16_t, ring_header_words> header;
+
+		if (!copy_from_user(process, ring.vaddr, header.data(), header.size()))
+		{
+			terminal->println(Arch::Terminal::Type::Kernel, "Process " + process->name + " async ring not mapped\n");
+			ring_setup(process, 0, 0);
+			return 0;
+		}
+
+		uint16_t &sq_head = header[0];
+		const uint16_t sq_tail = header[1];
+		const uint16_t cq_head = header[2];
+		uint16_t &cq_tail = header[3];
+
+		const uint16_t mask = ring.entries - 1;
+		const uint16_t sq_base = ring.vaddr + ring_header_words;
+		const uint16_t cq_base = sq_base + ring.entries * ring_submission_words;
+
+		std::string output;
+		uint16_t done = 0;
+		bool broken = false; // a completion or the header cannot be written
+
+		// stops when a submission has to wait or the completions are full
+		while (sq_head != sq_tail && done < Config::async_ring_batch && uint16_t(cq_tail - cq_head) < ring.entries)
+		{
+			std::array<uint16_t, ring_submission_words> sqe;
+			std::array<uint16_t, ring_completion_words> cqe = {sq_head, syscall_error};
+			const uint16_t cqe_vaddr = cq_base + (cq_tail & mask) * ring_completion_words;
+
+			if (!copy_from_user(process, sq_base + (sq_head & mask) * ring_submission_words, sqe.data(), sqe.size()))
+				break;
+
+			// the completion slot is written before the call runs, so the result of a call is never lost
+			if (!copy_to_user(process, cqe_vaddr, cqe.data(), cqe.size()))
+			{
+				broken = true;
+				break;
+			}
+
+			if (!ring_call(process, sqe, output, cqe[1]))
+				break;
+
+			sq_head++;
+			cq_tail++;
+			done++;
+
+			// the call may have unmapped the ring
+			if (!copy_to_user(process, cqe_vaddr, cqe.data(), cqe.size()))
+			{
+				broken = true;
+				break;
+			}
+		}
+
+		ring.pending = (sq_head != sq_tail);
+
+		if (!output.empty())
+			terminal->print_str(Arch::Terminal::Type::App, output);
+
+		if (done > 0 && !copy_to_user(process, ring.vaddr, header.data(), header.size()))
+			broken = true;
+
+		if (broken)
+		{
+			terminal->println(Arch::Terminal::Type::Kernel, "Process " + process->name + " async ring completions not writable\n");
+			ring_setup(process, 0, 0);
+		}
+
+		return done;
+	}
+
+	void drain_rings()
+	{
+		// a ring that is not mapped is unregistered while draining
+		for (Process *process = ring_processes.front(); process != nullptr;)
+		{
+			Process *next = process->ring_link.next;
+			drain_ring(process);
+			process = next;
+		}
+	}
+
+	// cycle of the next tick with ring work to do, UINT64_MAX if none
+	uint64_t ring_wakeup_cycle()
+	{
+		uint64_t wakeup_cycle = UINT64_MAX;
+
+		for (Process *process : ring_processes)
+		{
+			const AsyncRing &ring = process->ring;
+
+			if (ring.sleeping)
+				wakeup_cycle = std::min(wakeup_cycle, ring.wakeup_cycle);
+			else if (ring.pending)
+				wakeup_cycle = std::min<uint64_t>(wakeup_cycle, cpu->get_cycle() + machine->timer_interrupt_cycles);
+		}
+
+		return wakeup_cycle;
+	}
+
+	uint16_t set_real_time(Process *process, const uint16_t period_ticks, const uint16_t budget_ticks)
+	{
+		if (period_ticks == 0)
+		{
+			rt_scheduler.leave(process);
+			return 0;
+		}
+
+		if (!rt_scheduler.admit(process, period_ticks, budget_ticks, machine->timer_interrupt_cycles, cpu->get_cycle()))
+		{
+			terminal->println(Arch::Terminal::Type::Kernel, "Process " + process->name + " real-time reservation rejected\n");
+			return syscall_error;
+		}
+
+		return 0;
+	}
+
+	// processes that exited are only known by their pid
+	std::string trace_name(const uint16_t pid)
+	{
+		const Process *process = find_process(pid);
+		return (process != nullptr) ? process->name + "(" + std::to_string(pid) + ")" : "pid " + std::to_string(pid);
+	}
+
+	void show_trace()
+	{
+		const uint32_t n = trace_buffer.size();
+
+		terminal->println(Arch::Terminal::Type::Command, "Trace:\n");
+
+		for (uint32_t i = n - std::min(n, Config::trace_show_events); i < n; i++)
+			terminal->println(Arch::Terminal::Type::Command, trace_buffer.format(i, trace_name) + "\n");
+	}
+
+	void export_trace(const std::string &filename)
+	{
+		std::ofstream out(filename);
+
+		if (!out)
+		{
+			terminal->println(Arch::Terminal::Type::Command, "Cannot write " + filename + "\n");
+			return;
+		}
+
+		trace_buffer.write_chrome_json(out, trace_name);
+
+		terminal->println(Arch::Terminal::Type::Command, std::to_string(trace_buffer.size()) + " events written to " + filename + "\n");
+	}
+
+	// program of a live process, the profiler keeps the names of the exited ones
+	std::string program_name(const uint16_t pid)
+	{
+		if (const Process *process = find_process(pid))
+			return process->name;
+
+		return "pid " + std::to_string(pid);
+	}
+
+	// Samples the running process and the processes blocked in a syscall.
+	// Idle time is skipped without timer ticks, so each sample is weighted by the periods since the previous one.
+	void take_profile_sample()
+	{
+		const uint64_t periods = (cpu->get_cycle() - profile_cycle) / profile_period;
+
+		if (periods == 0)
+			return;
+
+		profile_cycle += periods * profile_period;
+
+		const uint16_t weight = std::min<uint64_t>(periods, UINT16_MAX);
+
+		profiler.record(current_process_ptr->pid, cpu->get_pc(), Profiler::no_syscall, weight);
+
+		for (const Process *process : processes)
+		{
+			// throttled real-time processes are only in a syscall if they ended their job
+			if (process->state == Process::State::Blocked && (process->wait_queue != &rt_scheduler.throttled || process->rt.job_done))
+				profiler.record(process->pid, process->pc, process->registers[0], weight);
+		}
+	}
+
+	void start_profile(const std::string &arg)
+	{
+		if (arg == "off")
+		{
+			profile_period = 0;
+			terminal->println(Arch::Terminal::Type::Command, "Profiler stopped, " + std::to_string(profiler.size()) + " samples\n");
+			return;
+		}
+
+		const uint32_t ticks = arg.empty() ? Config::profile_interval_ticks : (is_number(arg) ? std::stoul(arg) : 0);
+
+		if (ticks == 0)
+		{
+			terminal->println(Arch::Terminal::Type::Command, "Usage: profile [ticks|off]\n");
+			return;
+		}
+
+		profile_period = uint64_t(ticks) * machine->timer_interrupt_cycles;
+		profile_cycle = cpu->get_cycle();
+
+		terminal->println(Arch::Terminal::Type::Command, "Sampling every " + std::to_string(ticks) + " timer ticks, written to " + Config::profile_file + " at exit\n");
+	}
+
+	void write_profile()
+	{
+		std::ofstream out(Config::profile_file);
+
+		if (!out)
+		{
+			terminal->println(Arch::Terminal::Type::Kernel, std::string("Cannot write ") + Config::profile_file + "\n");
+			return;
+		}
+
+		profiler.write_folded(out, program_name);
+
+		std::string msg = std::to_string(profiler.size()) + " samples written to " + Config::profile_file;
+
+		if (profiler.get_dropped() > 0)
+			msg += ", " + std::to_string(profiler.get_dropped()) + " dropped with the buffer full";
+
+		terminal->println(Arch::Terminal::Type::Kernel, msg + "\n");
+	}
+
+	void deliver_input(Process *process, const int typed)
+	{
+		const uint16_t c = terminal->is_return(typed) ? '\n' : typed;
+
+		if (!process->input.push(c))
+			return;
+
+		terminal->print(Arch::Terminal::Type::App, static_cast<char>(c));
+
+		if (process->wait_queue == &input_waiters)
+			retry_syscall(process);
+	}
+
+	void kill(Process *process)
+	{
+		if (process->state == Process::State::Running)
+		{
+			panic("Process running");
+		}
+
+		desallocate_frame(process);
 		terminal->println(Arch::Terminal::Type::Command, "Process " + process->name + " killed\n");
-		terminal->println(Arch::Terminal::Type::Kernel, "Process " + process->name + " killed\n");
 
-		// ready_processes.erase(std::remove(ready_processes.begin(), ready_processes.end(), process), ready_processes.end());
-		// std::remove(ready_processes.begin(), ready_processes.end(), process);
-		ready_processes.remove(process);
-		blocked_processes.remove(process);
-		delete process;
+		if (script.loaded)
+			exited_processes.push_back({process->pid, process->name, process->start_cycle, cpu->get_cycle(), process->stats});
+		trace(TraceEvent::Kill, process);
+		profiler.process_exited(process->pid, process->name);
+
+		if (process->state == Process::State::Ready)
+			remove_ready(process);
+
+		else if (process->wait_queue != nullptr)
+		{
+			process->wait_queue->remove(process);
+			process->wait_queue = nullptr;
+		}
+
+		else if (process->state == Process::State::Blocked)
+			sleeping_processes.remove(process);
+
+		if (process == foreground_process)
+			foreground_process = nullptr;
+
+		ring_processes.remove(process);
+		rt_scheduler.leave(process);
+
+		unregister_process(process);
+		process_pool.free(process);
+	}
+
+	// terminates the running process and gives the cpu to the next one
+	void exit_current()
+	{
+		Process *process = current_process_ptr;
+
+		unschedule_process();
+		kill(process);
+		dispatch();
+	}
+
+	void set_nice(Process *process, const uint16_t nice)
+	{
+		process->nice = std::min<uint32_t>(nice, Config::mlfq_levels - 1);
 
-		ready_processes_begin = ready_processes.begin();
+		trace(TraceEvent::Nice, process, process->nice);
 	}
 
 	void verify_command()
@@ -370,8 +2462,12 @@ namespace OS
 			if (std::filesystem::exists(filename))
 			{
 				terminal->println(Arch::Terminal::Type::Command, "Running file:" + filename + "\n");
-				unschedule_process();
-				schedule_process(create_process(filename));
+				Process *process = create_process(filename);
+				if (process != nullptr)
+				{
+					preempt();
+					schedule_process(process);
+				}
 			}
 			else
 			{
@@ -394,36 +2490,108 @@ namespace OS
 		else if (typedCharacters.find("kill ") == 0)
 		{
 			typedCharacters.erase(0, 5);
-			std::string filename = typedCharacters;
+			std::string target = typedCharacters;
 			typedCharacters.clear();
-			Process *process = search_process(filename);
-			if (process != nullptr)
-			{
-				if (process == current_process_ptr)
-				{
-					Process *process_to_kill = current_process_ptr;
-					if (ready_processes.size() == 1)
-					{
-						unschedule_process();
-						schedule_process(idle_process_ptr);
-						kill(process_to_kill);
-					}
-					else
-					{
-						round_robin();
-						kill(process_to_kill);
-					}
-				}
-				else
-				{
-					kill(process);
-				}
-			}
+			Process *process = lookup_process(target);
+			if (process == current_process_ptr)
+				exit_current();
+			else if (process != nullptr)
+				kill(process);
+		}
+
+		else if (typedCharacters.find("nice ") == 0)
+		{
+			typedCharacters.erase(0, 5);
+			const auto space = typedCharacters.find(' ');
+			const std::string target = typedCharacters.substr(0, space);
+			const std::string value = (space == std::string::npos) ? "" : typedCharacters.substr(space + 1);
+			typedCharacters.clear();
+			if (!is_number(value))
+				terminal->println(Arch::Terminal::Type::Command, "Usage: nice <pid|name> <value>\n");
+			else if (Process *process = lookup_process(target))
+				set_nice(process, std::stoi(value.substr(0, 4)));
+		}
+
+		else if (typedCharacters == "top")
+		{
+			typedCharacters.clear();
+			top_live = !top_live;
+			top_ticks = 0;
+
+			if (top_live)
+				show_top();
 			else
+				terminal->println(Arch::Terminal::Type::Command, "top stopped\n");
+		}
+
+		else if (typedCharacters == "ipc")
+		{
+			typedCharacters.clear();
+			list_ipc();
+		}
+
+		else if (typedCharacters == "files")
+		{
+			typedCharacters.clear();
+			list_files();
+		}
+
+		else if (typedCharacters == "cache")
+		{
+			typedCharacters.clear();
+			show_cache();
+		}
+
+		else if (typedCharacters == "sync")
+		{
+			typedCharacters.clear();
+			terminal->println(Arch::Terminal::Type::Command, "Writing back " + std::to_string(sync_files()) + " blocks\n");
+		}
+
+		else if (typedCharacters == "trace")
+		{
+			typedCharacters.clear();
+			show_trace();
+		}
+
+		else if (typedCharacters.find("trace ") == 0)
+		{
+			const std::string filename = typedCharacters.substr(6);
+			typedCharacters.clear();
+			export_trace(filename);
+		}
+
+		else if (typedCharacters == "profile" || typedCharacters.find("profile ") == 0)
+		{
+			const std::string arg = (typedCharacters.size() > 8) ? typedCharacters.substr(8) : "";
+			typedCharacters.clear();
+			start_profile(arg);
+		}
+
+		else if (typedCharacters.find("fg ") == 0)
+		{
+			typedCharacters.erase(0, 3);
+			std::string target = typedCharacters;
+			typedCharacters.clear();
+			if (Process *process = lookup_process(target))
 			{
-				terminal->println(Arch::Terminal::Type::Command, "No process with this name to kill\n");
+				foreground_process = process;
+				terminal->println(Arch::Terminal::Type::Command, "Process " + process->name + " in foreground, ESC returns to the shell\n");
 			}
 		}
+
+		else if (typedCharacters == "sched" || typedCharacters.find("sched ") == 0)
+		{
+			const std::string policy = (typedCharacters.size() > 6) ? typedCharacters.substr(6) : "";
+			typedCharacters.clear();
+			if (policy == "rr")
+				set_scheduler(new RoundRobinScheduler);
+			else if (policy == "mlfq")
+				set_scheduler(new MlfqScheduler);
+			else if (!policy.empty())
+				terminal->println(Arch::Terminal::Type::Command, "Unknown scheduler " + policy + "\n");
+			terminal->println(Arch::Terminal::Type::Command, std::string("Scheduler: ") + scheduler->get_name() + "\n");
+		}
 		else
 		{
 			terminal->println(Arch::Terminal::Type::Command, "Unknown command");
@@ -431,10 +2599,8 @@ namespace OS
 		}
 	}
 
-	void write_command()
+	void write_command(const int typed)
 	{
-		int typed = terminal->read_typed_char();
-
 		if (terminal->is_alpha(typed) || terminal->is_num(typed) || typed == ' ' || typed == '-' || typed == '.' || typed == '/')
 		{
 			typedCharacters.push_back(static_cast<char>(typed));
@@ -458,81 +2624,275 @@ namespace OS
 		}
 	}
 
-	void boot(Arch::Terminal *terminal, Arch::Cpu *cpu)
+	void keyboard()
+	{
+		const int typed = terminal->read_typed_char();
+
+		if (foreground_process == nullptr)
+			write_command(typed);
+
+		else if (terminal->is_escape(typed))
+		{
+			terminal->println(Arch::Terminal::Type::Command, "Process " + foreground_process->name + " back to background\n");
+			foreground_process = nullptr;
+		}
+
+		else
+			deliver_input(foreground_process, typed);
+	}
+
+	bool script_ready()
+	{
+		return script.active && cpu->get_cycle() >= script.wakeup_cycle && !(script.wait_all && !processes.empty());
+	}
+
+	// cycle at which the script can go on, UINT64_MAX if it waits for processes or is done
+	uint64_t script_wakeup_cycle()
+	{
+		if (!script.active || (script.wait_all && !processes.empty()))
+			return UINT64_MAX;
+
+		return script.wakeup_cycle;
+	}
+
+	// runs script lines until one has to wait
+	// besides the shell commands, a script understands:
+	//   sleep N [cycles]  waits N simulated cycles
+	//   wait-all          waits until every process has exited
+	//   # comment
+	// the simulation is turned off at the end of the script
+	void run_script()
+	{
+		while (script_ready())
+		{
+			script.wait_all = false;
+
+			if (script.next == script.lines.size())
+			{
+				script.active = false;
+				cpu->turn_off();
+				return;
+			}
+
+			std::istringstream line(script.lines[script.next++]);
+			std::string command, arg, unit;
+
+			line >> command >> arg >> unit;
+
+			if (command.empty() || command[0] == '#')
+				continue;
+
+			terminal->println(Arch::Terminal::Type::Command, "> " + script.lines[script.next - 1] + "\n");
+
+			if (command == "wait-all")
+				script.wait_all = true;
+
+			else if (command == "sleep")
+			{
+				if (is_number(arg) && (unit.empty() || unit == "cycles"))
+					script.wakeup_cycle = cpu->get_cycle() + std::stoull(arg);
+				else
+					terminal->println(Arch::Terminal::Type::Command, "Usage: sleep <cycles> [cycles]\n");
+			}
+
+			else
+			{
+				typedCharacters = script.lines[script.next - 1];
+				verify_command();
+
+				if (command == "quit")
+					script.active = false;
+			}
+		}
+	}
+
+	// called before returning from the kernel
+	// when only the idle process is left, the cpu is halted until the next sleeper, ring or script is due
+	void update_cpu_halt()
+	{
+		if (current_process_ptr != idle_process_ptr)
+			cpu->resume();
+		else
+		{
+			uint64_t wakeup_cycle = std::min({ring_wakeup_cycle(), script_wakeup_cycle(), rt_scheduler.next_release(), disk->get_completion_cycle()});
+
+			if (!sleeping_processes.empty())
+				wakeup_cycle = std::min(wakeup_cycle, sleeping_processes.front()->wakeup_cycle);
+
+			cpu->halt(wakeup_cycle);
+		}
+	}
+
+	bool load_script(const std::string_view filename)
+	{
+		std::ifstream in{std::string(filename)};
+
+		if (!in)
+		{
+			terminal->println(Arch::Terminal::Type::Command, "Cannot read script " + std::string(filename) + "\n");
+			return false;
+		}
+
+		for (std::string line; std::getline(in, line);)
+			script.lines.push_back(line);
+
+		script.loaded = true;
+		script.active = true;
+
+		run_script();
+		update_cpu_halt();
+
+		return true;
+	}
+
+	void shutdown()
+	{
+		for (Buffer &buffer : buffer_cache.get_buffers())
+		{
+			if (buffer.dirty)
+			{
+				disk->write_now(buffer.block, buffer.data.data());
+				buffer.dirty = false;
+			}
+		}
+
+		if (directory_dirty)
+			write_directory();
+
+		if (profiler.size() > 0)
+			write_profile();
+	}
+
+	void print_summary(std::ostream &out)
+	{
+		const uint64_t now = cpu->get_cycle();
+
+		out << "cycles " << now << ", instructions " << cpu->get_executed_instructions() << "\n";
+		out << exited_processes.size() << " processes exited, " << processes.size() << " still alive\n";
+		out << paging_stats() << "\n";
+		out << "pid name state turnaround cpu_cycles instructions context_switches syscalls gpfs sleep_cycles\n";
+
+		auto print = [&out] (const uint16_t pid, const std::string &name, const char *state, const uint64_t turnaround, const ProcessStats &stats) {
+			out << pid << " " << name << " " << state << " " << turnaround << " " << stats.cpu_cycles << " " << stats.instructions << " "
+				<< stats.context_switches << " " << stats.syscalls << " " << stats.gpfs << " " << stats.sleep_cycles << "\n";
+		};
+
+		for (const ExitRecord &record : exited_processes)
+			print(record.pid, record.name, "exited", record.end_cycle - record.start_cycle, record.stats);
+
+		for (const Process *process : processes)
+			print(process->pid, process->name, state_str(process->state), now - process->start_cycle, current_stats(process));
+	}
+
+	void boot(Arch::Terminal *terminal, Arch::Cpu *cpu, Arch::Disk *disk)
 	{
 		OS::terminal = terminal;
 		OS::cpu = cpu;
+		OS::disk = disk;
+		OS::machine = &cpu->get_machine();
+
+		free_frames.assign(machine->memsize_words / machine->page_size_words, {nullptr, true, 0});
+		frame_needs_zero.assign(free_frames.size(), false);
+		zero_page_frame = allocate_frame(nullptr);
+
+		read_directory();
 		terminal->println(Arch::Terminal::Type::Command, "Type commands here");
 		terminal->println(Arch::Terminal::Type::App, "Apps output here");
 		terminal->println(Arch::Terminal::Type::Kernel, "Kernel output here");
+
+		if constexpr (Config::scheduler_policy == Config::SchedulerPolicy::Mlfq)
+			set_scheduler(new MlfqScheduler);
+		else
+			set_scheduler(new RoundRobinScheduler);
+
 		idle_process_ptr = create_process("bin/idle.bin");
 		if (idle_process_ptr == nullptr)
 			panic("Idle process not created");
 		else
 			schedule_process(idle_process_ptr);
+
+		update_cpu_halt();
 	}
 
 	void interrupt(const Arch::InterruptCode interrupt)
 	{
+		// before wakeup and the tick, which may switch processes
+		if (interrupt == Arch::InterruptCode::Timer && profile_period != 0)
+			take_profile_sample();
+
 		wakeup();
 
 		if (interrupt == Arch::InterruptCode::Keyboard)
-			write_command();
+			keyboard();
 
 		else if (interrupt == Arch::InterruptCode::Timer)
-			round_robin();
+		{
+			drain_rings();
+			timer_tick();
+
+			if (current_process_ptr == idle_process_ptr)
+				zero_idle_frames(Config::idle_zero_frames);
+
+			if (top_live && ++top_ticks >= Config::top_refresh_ticks)
+			{
+				top_ticks = 0;
+				show_top();
+			}
+
+			run_script();
+		}
+
+		else if (interrupt == Arch::InterruptCode::Disk)
+			disk_interrupt();
 
 		else if (interrupt == Arch::InterruptCode::GPF)
 		{
 			terminal->println(Arch::Terminal::Type::Kernel, "General Protection Fault\n");
-			Process *process_to_kill = current_process_ptr;
-			if (ready_processes.size() == 1)
-			{
-				unschedule_process();
-				schedule_process(idle_process_ptr);
-				kill(process_to_kill);
-			}
-			else
-			{
-				ready_processes_begin = ready_processes.begin();
-				round_robin();
-				kill(process_to_kill);
-			}
+			current_process_ptr->stats.gpfs++;
+			exit_current();
 		}
+
+		update_cpu_halt();
 	}
 
+	//  0: exit                     1: print string at r1         2: new line
+	//  3: print r1                  6: sleep r1 seconds           7: runtime in seconds
+	//  8: fork                      9: nice r1
+	// 10: read char                11: read line (r1 buffer, r2 size)
+	// 12: pipe create              13: pipe write (r1 id, r2 buffer, r3 len)
+	// 14: pipe read (r1 id, r2 buffer, r3 len)                    15: pipe close r1
+	// 16: mq create                17: mq send (r1 id, r2 buffer, r3 len)
+	// 18: mq receive (r1 id, r2 buffer, r3 size)                  19: mq close r1
+	// 20: shm get (r1 key, r2 size) 21: shm attach (r1 id, r2 page aligned address)
+	// 22: shm detach r1               23: write r2 characters at r1
+	// 24: async ring setup (r1 address, r2 entries, 0 to unregister)
+	// 25: async ring submit, runs the pending submissions now
+	// 26: real-time reservation (r1 period, r2 budget, in timer ticks, r1 = 0 back to best effort)
+	// 27: real-time wait, ends the job of the current period
+	// 28: open file (r1 name, r2 flags, 1 creates it), returns the descriptor
+	// 29: read file (r1 descriptor, r2 buffer, r3 len)      30: write file (r1 descriptor, r2 buffer, r3 len)
+	// 31: close file r1
+	// results are returned in r1, 0xFFFF on error
 	void syscall()
 	{
-		Process *process_to_kill = current_process_ptr;
+		current_process_ptr->stats.syscalls++;
+
 		switch (cpu->get_gpr(0))
 		{
 		case 0:
-			if (ready_processes.size() == 1)
-			{
-				unschedule_process();
-				schedule_process(idle_process_ptr);
-				kill(process_to_kill);
-				break;
-			}
-			round_robin();
-			kill(process_to_kill);
+			exit_current();
 			break;
 
 		case 1:
 		{
-			uint32_t v_addr = cpu->get_gpr(1);
-
-			while (true)
-			{
-				uint32_t p_addr = cpu->translate(&current_process_ptr->page_table, v_addr);
-				char ch = static_cast<char>(cpu->pmem_read(p_addr));
+			const uint16_t vaddr = cpu->get_gpr(1);
+			std::string str;
 
-				if (ch == '\0')
-					break;
+			const bool ok = read_user_string(current_process_ptr, vaddr, Config::virtual_space_size - vaddr, str);
+			terminal->print_str(Arch::Terminal::Type::App, str);
 
-				terminal->print(Arch::Terminal::Type::App, ch);
-				v_addr++;
-			}
+			if (!ok)
+				cpu->force_interrupt(Arch::InterruptCode::GPF);
 			break;
 		}
 		case 2:
@@ -545,25 +2905,135 @@ namespace OS
 		case 6:
 		{
 			Process *process_to_sleep = current_process_ptr;
-			time_t time_to_sleep = cpu->get_gpr(1);
-			if (ready_processes.size() == 1)
+			const uint16_t time_to_sleep = cpu->get_gpr(1);
+			unschedule_process();
+			sleep(process_to_sleep, time_to_sleep);
+			dispatch();
+			break;
+		}
+		case 7:
+		{
+			const uint64_t runtime = (cpu->get_cycle() - current_process_ptr->start_cycle) / Config::cycles_per_second;
+			cpu->set_gpr(1, runtime);
+			terminal->println(Arch::Terminal::Type::Kernel, "Actual Application Time: " + std::to_string(runtime) + "\n");
+			break;
+		}
+
+		case 8:
+		{
+			Process *child = fork_process();
+			cpu->set_gpr(1, (child != nullptr) ? child->pid : 0xFFFF);
+			break;
+		}
+
+		case 9:
+			set_nice(current_process_ptr, cpu->get_gpr(1));
+			break;
+
+		case 10:
+		case 11:
+		case 13:
+		case 14:
+		case 17:
+		case 18:
+		case 29:
+		case 30:
+		{
+			std::array<uint16_t, Config::max_nregs> regs;
+			uint16_t result;
+
+			for (uint32_t i = 0; i < machine->nregs; i++)
+				regs[i] = cpu->get_gpr(i);
+
+			WaitQueue *queue = blocking_syscall(current_process_ptr, regs, result);
+
+			if (queue == nullptr)
+				cpu->set_gpr(1, result);
+			else
 			{
+				Process *process = current_process_ptr;
 				unschedule_process();
-				schedule_process(idle_process_ptr);
-				sleep(process_to_sleep, time_to_sleep);
+				block(process, *queue);
+				dispatch();
 			}
-			else
+			break;
+		}
+
+		case 12:
+			cpu->set_gpr(1, pipe_create());
+			break;
+
+		case 15:
+			cpu->set_gpr(1, pipe_close(cpu->get_gpr(1)));
+			break;
+
+		case 16:
+			cpu->set_gpr(1, mq_create());
+			break;
+
+		case 19:
+			cpu->set_gpr(1, mq_close(cpu->get_gpr(1)));
+			break;
+
+		case 20:
+			cpu->set_gpr(1, shm_get(cpu->get_gpr(1), cpu->get_gpr(2)));
+			break;
+
+		case 21:
+			cpu->set_gpr(1, shm_attach(current_process_ptr, cpu->get_gpr(1), cpu->get_gpr(2)));
+			break;
+
+		case 22:
+			cpu->set_gpr(1, shm_detach(current_process_ptr, cpu->get_gpr(1)));
+			break;
+
+		case 23:
+		{
+			const uint16_t len = cpu->get_gpr(2);
+			std::string str;
+
+			if (read_user_chars(current_process_ptr, cpu->get_gpr(1), len, str))
 			{
-				round_robin();
-				sleep(process_to_sleep, time_to_sleep);
+				terminal->print_str(Arch::Terminal::Type::App, str);
+				cpu->set_gpr(1, len);
 			}
+			else
+				cpu->set_gpr(1, syscall_error);
 			break;
 		}
-		case 7:
-			time_t runtime = time(NULL) - current_process_ptr->start_application_time;
-			cpu->set_gpr(1, runtime);
-			terminal->println(Arch::Terminal::Type::Kernel, "Actual Application Time: " + std::to_string(runtime) + "\n");
+
+		case 24:
+			cpu->set_gpr(1, ring_setup(current_process_ptr, cpu->get_gpr(1), cpu->get_gpr(2)));
+			break;
+
+		case 25:
+			cpu->set_gpr(1, (current_process_ptr->ring.entries != 0) ? drain_ring(current_process_ptr) : syscall_error);
+			break;
+
+		case 26:
+			cpu->set_gpr(1, set_real_time(current_process_ptr, cpu->get_gpr(1), cpu->get_gpr(2)));
+			break;
+
+		case 27:
+			if (rt_scheduler.is_member(current_process_ptr))
+			{
+				current_process_ptr->rt.job_done = true;
+				cpu->set_gpr(1, 0);
+				throttle_current();
+			}
+			else
+				cpu->set_gpr(1, syscall_error);
+			break;
+
+		case 28:
+			cpu->set_gpr(1, file_open(current_process_ptr, cpu->get_gpr(1), cpu->get_gpr(2)));
+			break;
+
+		case 31:
+			cpu->set_gpr(1, file_close(current_process_ptr, cpu->get_gpr(1)));
 			break;
 		}
+
+		update_cpu_halt();
 	}
 }
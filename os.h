@@ -1,6 +1,9 @@
 #ifndef __ARQSIM_HEADER_OS_H__
 #define __ARQSIM_HEADER_OS_H__
 
+#include <string_view>
+#include <ostream>
+
 #include <cstdint>
 
 #include <my-lib/std.h>
@@ -14,12 +17,25 @@ namespace OS
 
     // ---------------------------------------
 
-    void boot(Arch::Terminal *terminal, Arch::Cpu *cpu);
+    void boot(Arch::Terminal *terminal, Arch::Cpu *cpu, Arch::Disk *disk);
+
+    // writes the dirty buffers of the file system back to the disk image
+    void shutdown();
+
+    // runs the shell commands of a file as the simulation goes, see run_script()
+    bool load_script(const std::string_view filename);
+
+    // cycle counts and per-process accounting, printed at exit when a script was loaded
+    void print_summary(std::ostream &out);
 
     void interrupt(const Arch::InterruptCode interrupt);
 
     void syscall();
 
+    // called by the cpu when a store hits a read-only page
+    // returns true if the page is now writable
+    bool write_fault(const uint16_t vaddr);
+
     // ---------------------------------------
 
 } // end namespace